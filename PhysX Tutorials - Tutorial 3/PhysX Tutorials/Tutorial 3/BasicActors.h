@@ -198,6 +198,59 @@ namespace PhysicsEngine
 
 
 
+	///The HeightField class
+	class HeightField : public StaticActor
+	{
+		PxHeightField* heightfield;
+
+	public:
+		//a terrain from a grid of heights:
+		// - heights: rows x columns samples, row by row
+		// - rows along the X axis, columns along the Z axis, spaced by row_scale and column_scale
+		HeightField(const std::vector<PxReal>& heights, PxU32 rows, PxU32 columns, const PxTransform& pose=PxTransform(PxIdentity),
+			PxReal row_scale=1.f, PxReal column_scale=1.f)
+			: StaticActor(pose)
+		{
+			if ((rows < 2) || (columns < 2) || (heights.size() != rows*columns))
+				throw new Exception("HeightField::HeightField, invalid sample grid.");
+
+			//heights are stored as 16 bit integers, use the full range
+			PxReal max_height = 0.f;
+			for (PxU32 i = 0; i < heights.size(); i++)
+				max_height = PxMax(max_height, PxAbs(heights[i]));
+			PxReal height_scale = (max_height > 0.f) ? max_height / 32767.f : 1.f;
+
+			std::vector<PxHeightFieldSample> samples(heights.size());
+			for (PxU32 i = 0; i < heights.size(); i++)
+			{
+				samples[i].height = (PxI16)PxClamp(heights[i] / height_scale, -32767.f, 32767.f);
+				samples[i].materialIndex0 = 0;
+				samples[i].materialIndex1 = 0;
+			}
+
+			PxHeightFieldDesc desc;
+			desc.format = PxHeightFieldFormat::eS16_TM;
+			desc.nbRows = rows;
+			desc.nbColumns = columns;
+			desc.samples.data = &samples.front();
+			desc.samples.stride = sizeof(PxHeightFieldSample);
+
+			heightfield = GetPhysics()->createHeightField(desc);
+			if (!heightfield)
+				throw new Exception("HeightField::HeightField, could not create heightfield.");
+
+			CreateShape(PxHeightFieldGeometry(heightfield, PxMeshGeometryFlags(), height_scale, row_scale, column_scale));
+		}
+
+		~HeightField()
+		{
+			//the shape holds its own reference until the actor is released
+			heightfield->release();
+		}
+	};
+
+
+
 	class Club : public DynamicActor
 	{
 	public:
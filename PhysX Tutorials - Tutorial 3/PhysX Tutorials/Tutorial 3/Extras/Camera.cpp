@@ -59,6 +59,16 @@ namespace VisualDebugger
 		return PxTransform(eye, PxQuat(m));
 	}
 
+	PxVec3 Camera::getRay(PxReal x, PxReal y, PxReal field_of_view, PxReal aspect) const
+	{
+		//the same basis as gluLookAt with the y axis up
+		PxVec3 right = dir.cross(PxVec3(0, 1, 0)).getNormalized();
+		PxVec3 up = right.cross(dir);
+		PxReal tan_half = PxTan(PxPi * field_of_view / 360.f);
+
+		return (dir + right*(x*tan_half*aspect) + up*(y*tan_half)).getNormalized();
+	}
+
 	void Camera::MoveForward(PxReal delta_time)
 	{
 		PxVec3 viewY = dir.cross(PxVec3(1, 0, 0)).getNormalized();
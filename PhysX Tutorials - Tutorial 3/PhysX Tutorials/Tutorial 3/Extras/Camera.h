@@ -37,6 +37,10 @@ namespace VisualDebugger
 		///get camera transformation
 		PxTransform	getTransform() const;
 
+		///get the direction of a ray from the eye through a point of the view
+		///(x, y from -1 at the bottom left to 1 at the top right, vertical field of view in degrees)
+		PxVec3 getRay(PxReal x, PxReal y, PxReal field_of_view, PxReal aspect) const;
+
 		///move camera forward
 		void MoveForward(PxReal delta_time);
 
@@ -0,0 +1,236 @@
+#include "FrameRecorder.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstddef>
+
+//pixel buffer objects (GL 2.1, GL_ARB_pixel_buffer_object), missing from the GL 1.1 headers
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#define GL_STREAM_READ 0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#define GL_READ_ONLY 0x88B8
+#endif
+
+namespace VisualDebugger
+{
+	typedef void (APIENTRY *GenBuffersProc)(GLsizei n, GLuint* buffers);
+	typedef void (APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+	typedef void (APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+	typedef void (APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+	typedef void* (APIENTRY *MapBufferProc)(GLenum target, GLenum access);
+	typedef GLboolean (APIENTRY *UnmapBufferProc)(GLenum target);
+
+	GenBuffersProc glGenBuffersPtr = 0;
+	DeleteBuffersProc glDeleteBuffersPtr = 0;
+	BindBufferProc glBindBufferPtr = 0;
+	BufferDataProc glBufferDataPtr = 0;
+	MapBufferProc glMapBufferPtr = 0;
+	UnmapBufferProc glUnmapBufferPtr = 0;
+
+	///Load the pixel buffer entry points, returns false if they are not available
+	bool LoadPixelBuffers()
+	{
+#ifdef _WIN32
+		glGenBuffersPtr = (GenBuffersProc)wglGetProcAddress("glGenBuffers");
+		glDeleteBuffersPtr = (DeleteBuffersProc)wglGetProcAddress("glDeleteBuffers");
+		glBindBufferPtr = (BindBufferProc)wglGetProcAddress("glBindBuffer");
+		glBufferDataPtr = (BufferDataProc)wglGetProcAddress("glBufferData");
+		glMapBufferPtr = (MapBufferProc)wglGetProcAddress("glMapBuffer");
+		glUnmapBufferPtr = (UnmapBufferProc)wglGetProcAddress("glUnmapBuffer");
+#endif
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		return extensions && strstr(extensions, "GL_ARB_pixel_buffer_object") &&
+			glGenBuffersPtr && glDeleteBuffersPtr && glBindBufferPtr && glBufferDataPtr && glMapBufferPtr && glUnmapBufferPtr;
+	}
+
+	FrameRecorder::FrameRecorder(const std::string& _path, PxU32 _max_queued)
+		: path(_path), frame_count(0), slot_index(0), quit(false), max_queued(_max_queued), dropped(0)
+	{
+		pixel_buffers = LoadPixelBuffers();
+		for (int i = 0; i < 2; i++)
+		{
+			slots[i].buffer = 0;
+			slots[i].width = slots[i].height = 0;
+			slots[i].pending = false;
+			if (pixel_buffers)
+				glGenBuffersPtr(1, &slots[i].buffer);
+		}
+
+		writer = std::thread(&FrameRecorder::Run, this);
+	}
+
+	FrameRecorder::~FrameRecorder()
+	{
+		//the older read first
+		Collect(slots[(slot_index + 1) % 2]);
+		Collect(slots[slot_index]);
+		if (pixel_buffers)
+		{
+			for (int i = 0; i < 2; i++)
+				glDeleteBuffersPtr(1, &slots[i].buffer);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake_up.notify_one();
+		writer.join();
+
+		for (unsigned int i = 0; i < free_frames.size(); i++)
+			delete free_frames[i];
+	}
+
+	void FrameRecorder::Capture(int x, int y, int width, int height)
+	{
+		PxU32 number = frame_count++;
+
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadBuffer(GL_BACK);
+
+		if (!pixel_buffers)
+		{
+			//synchronous read, only the file writing is left to the writer
+			Frame* frame = NewFrame(number, width, height);
+			if (frame)
+			{
+				glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, &frame->pixels.front());
+				Push(frame);
+			}
+			return;
+		}
+
+		//the previous frame has had a whole frame to arrive
+		Collect(slots[(slot_index + 1) % 2]);
+
+		//start reading this frame, glReadPixels returns without waiting
+		ReadSlot& slot = slots[slot_index];
+		Collect(slot);
+		glBindBufferPtr(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		if ((slot.width != width) || (slot.height != height))
+		{
+			glBufferDataPtr(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)width*height*3, 0, GL_STREAM_READ);
+			slot.width = width;
+			slot.height = height;
+		}
+		glReadPixels(x, y, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		glBindBufferPtr(GL_PIXEL_PACK_BUFFER, 0);
+		slot.number = number;
+		slot.pending = true;
+
+		slot_index = (slot_index + 1) % 2;
+	}
+
+	PxU32 FrameRecorder::Dropped()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return dropped;
+	}
+
+	///Copy a finished read out of its pixel buffer and queue it
+	void FrameRecorder::Collect(ReadSlot& slot)
+	{
+		if (!slot.pending)
+			return;
+		slot.pending = false;
+
+		Frame* frame = NewFrame(slot.number, slot.width, slot.height);
+		if (!frame)
+			return;
+
+		glBindBufferPtr(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const void* pixels = glMapBufferPtr(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (pixels)
+		{
+			memcpy(&frame->pixels.front(), pixels, frame->pixels.size());
+			glUnmapBufferPtr(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBufferPtr(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (pixels)
+			Push(frame);
+		else
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			free_frames.push_back(frame);
+		}
+	}
+
+	///Get a frame to fill, returns 0 (and counts a dropped frame) if the writer is too far behind
+	FrameRecorder::Frame* FrameRecorder::NewFrame(PxU32 number, int width, int height)
+	{
+		Frame* frame = 0;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (queue.size() >= max_queued)
+			{
+				dropped++;
+				return 0;
+			}
+			if (free_frames.size())
+			{
+				frame = free_frames.back();
+				free_frames.pop_back();
+			}
+		}
+
+		if (!frame)
+			frame = new Frame();
+		frame->number = number;
+		frame->width = width;
+		frame->height = height;
+		frame->pixels.resize(width*height*3);
+		return frame;
+	}
+
+	void FrameRecorder::Push(Frame* frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(frame);
+		}
+		wake_up.notify_one();
+	}
+
+	void FrameRecorder::Run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			wake_up.wait(lock, [this] { return quit || queue.size(); });
+			if (!queue.size())
+				return;
+
+			Frame* frame = queue.front();
+			queue.pop_front();
+
+			lock.unlock();
+			Write(*frame);
+			lock.lock();
+
+			free_frames.push_back(frame);
+		}
+	}
+
+	///Write a single frame as a binary PPM
+	void FrameRecorder::Write(const Frame& frame)
+	{
+		std::ostringstream file_name;
+		file_name << path << "_" << std::setw(5) << std::setfill('0') << frame.number << ".ppm";
+
+		std::ofstream file(file_name.str().c_str(), std::ios::binary);
+		if (!file)
+			return;
+
+		file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+		//GL rows start at the bottom
+		for (int row = frame.height - 1; row >= 0; row--)
+			file.write((const char*)&frame.pixels[row*frame.width*3], frame.width*3);
+	}
+
+}
\ No newline at end of file
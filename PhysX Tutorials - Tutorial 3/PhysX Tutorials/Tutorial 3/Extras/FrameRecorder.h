@@ -0,0 +1,79 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <GL/glut.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace VisualDebugger
+{
+	using namespace physx;
+
+	///Records rendered frames to a numbered PPM sequence (path_00000.ppm, ...).
+	///Pixels are read back through two pixel buffers one frame late, so the read never waits for the GPU,
+	///and files are written on a separate thread, so rendering never waits for the disk.
+	class FrameRecorder
+	{
+		///A frame waiting to be written
+		struct Frame
+		{
+			PxU32 number;
+			int width, height;
+			std::vector<unsigned char> pixels;
+		};
+
+		///A pixel buffer with a read in flight
+		struct ReadSlot
+		{
+			GLuint buffer;
+			PxU32 number;
+			int width, height;
+			bool pending;
+		};
+
+		std::string path;
+		PxU32 frame_count;
+		bool pixel_buffers;
+		ReadSlot slots[2];
+		unsigned int slot_index;
+
+		std::thread writer;
+		std::mutex mutex;
+		std::condition_variable wake_up;
+		bool quit;
+		//frames to write and recycled frames, protected by the mutex
+		std::deque<Frame*> queue;
+		std::vector<Frame*> free_frames;
+		PxU32 max_queued;
+		PxU32 dropped;
+
+	public:
+		///Start recording, must be called with a current GL context.
+		///At most max_queued frames wait for the writer, later ones are dropped instead of stalling.
+		FrameRecorder(const std::string& path, PxU32 max_queued=64);
+
+		///Write the remaining frames and stop the writer
+		~FrameRecorder();
+
+		///Capture the given part of the back buffer (call before swapping buffers)
+		void Capture(int x, int y, int width, int height);
+
+		///Number of captured frames
+		PxU32 Frames() { return frame_count; }
+
+		///Number of frames dropped because the writer could not keep up
+		PxU32 Dropped();
+
+	private:
+		void Collect(ReadSlot& slot);
+		Frame* NewFrame(PxU32 number, int width, int height);
+		void Push(Frame* frame);
+		void Run();
+		void Write(const Frame& frame);
+	};
+
+}
\ No newline at end of file
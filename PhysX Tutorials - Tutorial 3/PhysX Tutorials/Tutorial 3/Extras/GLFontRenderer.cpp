@@ -11,6 +11,7 @@ unsigned int GLFontRenderer::m_textureObject=0;
 int GLFontRenderer::m_screenWidth=640;
 int GLFontRenderer::m_screenHeight=480;
 float GLFontRenderer::m_color[4]={1.0f, 1.0f, 1.0f, 1.0f};
+std::vector<GLFontRenderer::GlyphVertex> GLFontRenderer::m_vertices;
 
 bool GLFontRenderer::init()
 {
@@ -37,18 +38,104 @@ bool GLFontRenderer::init()
 }
 
 void GLFontRenderer::print(float x, float y, float fontSize, const char* pString, bool forceMonoSpace, int monoSpaceWidth, bool doOrthoProj)
+{
+	add(x, y, fontSize, pString, forceMonoSpace, monoSpaceWidth);
+	flush(doOrthoProj);
+}
+
+void GLFontRenderer::add(float x, float y, float fontSize, const char* pString, bool forceMonoSpace, int monoSpaceWidth)
+{
+	layout(x, y, fontSize, pString, m_vertices, forceMonoSpace, monoSpaceWidth);
+}
+
+void GLFontRenderer::add(const std::vector<GlyphVertex>& vertices)
+{
+	m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+}
+
+void GLFontRenderer::layout(float x, float y, float fontSize, const char* pString, std::vector<GlyphVertex>& vertices, bool forceMonoSpace, int monoSpaceWidth)
 {
 	x = x*m_screenWidth;
 	y = y*m_screenHeight;
 	fontSize = fontSize*m_screenHeight;
 
+	unsigned int num = (unsigned int)strlen(pString);
+	if(num == 0) return;
+
+	GlyphVertex corner;
+	for(int i=0;i<4;i++)
+	{
+		float c = m_color[i] < 0.0f ? 0.0f : (m_color[i] > 1.0f ? 1.0f : m_color[i]);
+		corner.color[i] = (unsigned char)(c*255.0f+0.5f);
+	}
+
+	const float glyphHeightUV = ((float)OGL_FONT_CHARS_PER_COL)/OGL_FONT_TEXTURE_HEIGHT*2-0.01f;
+	const float glyphWidthUV = ((float)OGL_FONT_CHARS_PER_ROW)/OGL_FONT_TEXTURE_WIDTH;
+
+	float translate = 0.0f;
+	float translateDown = 0.0f;
+
+	vertices.reserve(vertices.size()+num*6);
+
+	for(unsigned int i=0;i<num; i++)
+	{
+		if (pString[i] == '\n') {
+			translateDown-=0.005f*m_screenHeight+fontSize;
+			translate = 0.0f;
+			continue;
+		}
+
+		int c = pString[i]-OGL_FONT_CHAR_BASE;
+		if (c < OGL_FONT_CHARS_PER_ROW*OGL_FONT_CHARS_PER_COL) {
+
+			float glyphWidth = (float)GLFontGlyphWidth[c];
+			if(forceMonoSpace){
+				glyphWidth = (float)monoSpaceWidth;
+			}
+			
+			glyphWidth = glyphWidth*(fontSize/(((float)OGL_FONT_TEXTURE_WIDTH)/OGL_FONT_CHARS_PER_ROW))-0.01f;
+
+			float cxUV = float((c)%OGL_FONT_CHARS_PER_ROW)/OGL_FONT_CHARS_PER_ROW+0.008f;
+			float cyUV = float((c)/OGL_FONT_CHARS_PER_ROW)/OGL_FONT_CHARS_PER_COL+0.008f;
+
+			float left = x+translate;
+			float right = x+fontSize+translate;
+			float bottom = y+translateDown;
+			float top = y+fontSize+translateDown;
+
+			// two triangles: bottom left, top right, top left and bottom left, bottom right, top right
+			const float quad[6][4] = {
+				{ left, bottom, cxUV, cyUV+glyphHeightUV },
+				{ right, top, cxUV+glyphWidthUV, cyUV },
+				{ left, top, cxUV, cyUV },
+				{ left, bottom, cxUV, cyUV+glyphHeightUV },
+				{ right, bottom, cxUV+glyphWidthUV, cyUV+glyphHeightUV },
+				{ right, top, cxUV+glyphWidthUV, cyUV }
+			};
+			for(int j=0;j<6;j++)
+			{
+				corner.x = quad[j][0];
+				corner.y = quad[j][1];
+				corner.u = quad[j][2];
+				corner.v = quad[j][3];
+				vertices.push_back(corner);
+			}
+
+			translate+=glyphWidth;
+		}
+	}
+}
+
+bool GLFontRenderer::flush(bool doOrthoProj)
+{
+	if(m_vertices.empty()) return false;
+
 	if(!m_isInit)
 	{
 		m_isInit = init();
 	}
 
-	unsigned int num = (unsigned int)strlen(pString);
-	if(m_isInit && num > 0)
+	if(m_isInit)
 	{
 		glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
 		glDisable(GL_DEPTH_TEST);
@@ -57,7 +144,6 @@ void GLFontRenderer::print(float x, float y, float fontSize, const char* pString
 		glEnable(GL_TEXTURE_2D);
 		glBindTexture(GL_TEXTURE_2D, m_textureObject);
 
-
 		if(doOrthoProj)
 		{
 			glMatrixMode(GL_PROJECTION);
@@ -71,96 +157,18 @@ void GLFontRenderer::print(float x, float y, float fontSize, const char* pString
 
 		glEnable(GL_BLEND);
 
-		glColor4f(m_color[0], m_color[1], m_color[2], m_color[3]);
-
-		const float glyphHeightUV = ((float)OGL_FONT_CHARS_PER_COL)/OGL_FONT_TEXTURE_HEIGHT*2-0.01f;
-
-		float translate = 0.0f;
-
-		float* pVertList = new float[num*3*6];
-    	float* pTextureCoordList = new float[num*2*6];
-		int vertIndex = 0;
-    	int textureCoordIndex = 0;
-
-		float translateDown = 0.0f;
-		unsigned int count = 0;
-
-		for(unsigned int i=0;i<num; i++)
-		{
-			const float glyphWidthUV = ((float)OGL_FONT_CHARS_PER_ROW)/OGL_FONT_TEXTURE_WIDTH;
-
-			if (pString[i] == '\n') {
-				translateDown-=0.005f*m_screenHeight+fontSize;
-				translate = 0.0f;
-				continue;
-			}
-
-			int c = pString[i]-OGL_FONT_CHAR_BASE;
-			if (c < OGL_FONT_CHARS_PER_ROW*OGL_FONT_CHARS_PER_COL) {
-
-				count++;
-
-				float glyphWidth = (float)GLFontGlyphWidth[c];
-				if(forceMonoSpace){
-					glyphWidth = (float)monoSpaceWidth;
-				}
-				
-				glyphWidth = glyphWidth*(fontSize/(((float)OGL_FONT_TEXTURE_WIDTH)/OGL_FONT_CHARS_PER_ROW))-0.01f;
-
-				float cxUV = float((c)%OGL_FONT_CHARS_PER_ROW)/OGL_FONT_CHARS_PER_ROW+0.008f;
-				float cyUV = float((c)/OGL_FONT_CHARS_PER_ROW)/OGL_FONT_CHARS_PER_COL+0.008f;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV+glyphHeightUV;
-				pVertList[vertIndex++] = x+0+translate;
-				pVertList[vertIndex++] = y+0+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV+glyphWidthUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV;
-				pVertList[vertIndex++] = x+fontSize+translate;
-				pVertList[vertIndex++] = y+fontSize+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV;
-				pVertList[vertIndex++] = x+0+translate;
-				pVertList[vertIndex++] = y+fontSize+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV+glyphHeightUV;
-				pVertList[vertIndex++] = x+0+translate;
-				pVertList[vertIndex++] = y+0+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV+glyphWidthUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV+glyphHeightUV;
-				pVertList[vertIndex++] = x+fontSize+translate;
-				pVertList[vertIndex++] = y+0+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				pTextureCoordList[textureCoordIndex++] = cxUV+glyphWidthUV;
-				pTextureCoordList[textureCoordIndex++] = cyUV;
-				pVertList[vertIndex++] = x+fontSize+translate;
-				pVertList[vertIndex++] = y+fontSize+translateDown;
-				pVertList[vertIndex++] = 0;
-
-				translate+=glyphWidth;
-			}
-		}
-
+		const GlyphVertex* pVertices = &m_vertices.front();
 		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(3, GL_FLOAT, 0, pVertList);
+		glVertexPointer(2, GL_FLOAT, sizeof(GlyphVertex), &pVertices->x);
 		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-		glTexCoordPointer(2, GL_FLOAT, 0, pTextureCoordList);
-		glDrawArrays(GL_TRIANGLES, 0, count*6);
+		glTexCoordPointer(2, GL_FLOAT, sizeof(GlyphVertex), &pVertices->u);
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(GlyphVertex), pVertices->color);
+		glDrawArrays(GL_TRIANGLES, 0, (GLsizei)m_vertices.size());
+		glDisableClientState(GL_COLOR_ARRAY);
 		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 		glDisableClientState(GL_VERTEX_ARRAY);
 
-		delete[] pVertList;
-		delete[] pTextureCoordList;
-
 		if(doOrthoProj)
 		{
 			glMatrixMode(GL_PROJECTION);
@@ -174,6 +182,10 @@ void GLFontRenderer::print(float x, float y, float fontSize, const char* pString
 		glDisable(GL_TEXTURE_2D);	
 		glDisable(GL_BLEND);
 	}
+
+	// keep the capacity for the next frame
+	m_vertices.clear();
+	return m_isInit;
 }
 
 void GLFontRenderer::setScreenResolution(int screenWidth, int screenHeight)
@@ -9,7 +9,19 @@
 #ifndef __GL_FONT_RENDERER__
 #define __GL_FONT_RENDERER__
 
+#include <vector>
+
 class GLFontRenderer{
+
+public:
+
+	// a single glyph corner, interleaved for one draw call per batch
+	struct GlyphVertex
+	{
+		float x, y;
+		float u, v;
+		unsigned char color[4];
+	};
 	
 private:
 
@@ -18,11 +30,20 @@ private:
 	static int m_screenWidth;
 	static int m_screenHeight;
 	static float m_color[4];
+	static std::vector<GlyphVertex> m_vertices;
 
 public:
 	
 	static bool init();
 	static void print(float x, float y, float fontSize, const char* pString, bool forceMonoSpace=false, int monoSpaceWidth=11, bool doOrthoProj=true);
+	// queue a string in the current color, it is drawn by the next flush
+	static void add(float x, float y, float fontSize, const char* pString, bool forceMonoSpace=false, int monoSpaceWidth=11);
+	// queue glyphs laid out before
+	static void add(const std::vector<GlyphVertex>& vertices);
+	// append the glyphs of a string in the current color, e.g. to draw them again without repeating the layout
+	static void layout(float x, float y, float fontSize, const char* pString, std::vector<GlyphVertex>& vertices, bool forceMonoSpace=false, int monoSpaceWidth=11);
+	// draw all queued strings with a single state setup and draw call
+	static bool flush(bool doOrthoProj=true);
 	static void setScreenResolution(int screenWidth, int screenHeight);
 	static void setColor(float r, float g, float b, float a);
 	
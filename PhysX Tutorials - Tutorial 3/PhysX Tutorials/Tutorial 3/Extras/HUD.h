@@ -2,44 +2,84 @@
 
 #include "Renderer.h"
 #include <string>
-#include <list>
+#include <vector>
+#include <unordered_map>
 
 namespace VisualDebugger
 {
 	using namespace std;
 
-	///A single HUD screen
+	///A single HUD screen. The text is laid out once and again only after
+	///the content, font or window size has changed.
 	class HUDScreen
 	{
 		vector<string> content;
+		PxReal font_size;
+		PxVec3 color;
+		Renderer::TextLayout layout;
+		bool dirty;
+		//window size of the current layout
+		int layout_width, layout_height;
 
 	public:
 		int id;
-		PxReal font_size;
-		PxVec3 color;
 
 		HUDScreen(int screen_id, const PxVec3& _color=PxVec3(1.f,1.f,1.f), const PxReal& _font_size=0.024f) :
-			id(screen_id), color(_color), font_size(_font_size)
+			font_size(_font_size), color(_color), dirty(true), layout_width(0), layout_height(0), id(screen_id)
 		{
 		}
 
-		///Add a single line of text
-		void AddLine(string line)
+		///Add a single line of text, returns the index of the line
+		unsigned int AddLine(const string& line)
 		{
 			content.push_back(line);
+			dirty = true;
+			return (unsigned int)content.size() - 1;
+		}
+
+		///Change a single line of text (e.g. a value), nothing happens if it is the same
+		void SetLine(unsigned int index, const string& line)
+		{
+			if ((index >= content.size()) || (content[index] == line))
+				return;
+			content[index] = line;
+			dirty = true;
+		}
+
+		///Set the font size
+		void FontSize(PxReal value)
+		{
+			font_size = value;
+			dirty = true;
+		}
+
+		///Set the font color
+		void Color(const PxVec3& value)
+		{
+			color = value;
+			dirty = true;
 		}
 
 		///Render the screen
 		void Render()
 		{
-			for (unsigned int i = 0; i < content.size(); i++)
-				Renderer::RenderText(content[i], PxVec2(0.0, 1.f-(i+1)*font_size), color, font_size);
+			if (dirty || (layout_width != Renderer::WindowWidth()) || (layout_height != Renderer::WindowHeight()))
+			{
+				layout.clear();
+				for (unsigned int i = 0; i < content.size(); i++)
+					Renderer::LayoutText(content[i], PxVec2(0.0, 1.f-(i+1)*font_size), color, font_size, layout);
+				layout_width = Renderer::WindowWidth();
+				layout_height = Renderer::WindowHeight();
+				dirty = false;
+			}
+			Renderer::RenderText(layout);
 		}
 
 		///Clear content of the screen
 		void Clear()
 		{
 			content.clear();
+			dirty = true;
 		}
 	};
 
@@ -47,29 +87,41 @@ namespace VisualDebugger
 	class HUD
 	{
 		int active_screen;
-		vector<HUDScreen*> screens;
+		unordered_map<int, HUDScreen*> screens;
+
+		HUDScreen* Find(int screen_id)
+		{
+			unordered_map<int, HUDScreen*>::iterator screen = screens.find(screen_id);
+			return (screen != screens.end()) ? screen->second : 0;
+		}
 
 	public:
+		HUD() : active_screen(0) {}
+
 		~HUD()
 		{
-			for (unsigned int i = 0; i < screens.size(); i++)
-				delete screens[i];
+			for (unordered_map<int, HUDScreen*>::iterator i = screens.begin(); i != screens.end(); i++)
+				delete i->second;
 		}
 
-		///Add a single line to a specific screen
-		void AddLine(int screen_id, string line)
+		///Add a single line to a specific screen, returns the index of the line
+		unsigned int AddLine(int screen_id, const string& line)
 		{
-			for (unsigned int i = 0; i < screens.size(); i++)
+			HUDScreen* screen = Find(screen_id);
+			if (!screen)
 			{
-				if (screens[i]->id == screen_id)
-				{
-					screens[i]->AddLine(line);
-					return;
-				}
+				screen = new HUDScreen(screen_id);
+				screens[screen_id] = screen;
 			}
+			return screen->AddLine(line);
+		}
 
-			screens.push_back(new HUDScreen(screen_id));
-			screens.back()->AddLine(line);
+		///Change a single line of a specific screen (the screen is laid out again only if the line changed)
+		void SetLine(int screen_id, unsigned int index, const string& line)
+		{
+			HUDScreen* screen = Find(screen_id);
+			if (screen)
+				screen->SetLine(index, line);
 		}
 
 		///Set the active screen
@@ -89,81 +141,42 @@ namespace VisualDebugger
 		{
 			if (screen_id == -1)
 			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					screens[i]->Clear();
-				}
-			}
-			else
-			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					if (screens[i]->id == screen_id)
-					{
-						screens[i]->Clear();
-						return;
-					}
-				}
+				for (unordered_map<int, HUDScreen*>::iterator i = screens.begin(); i != screens.end(); i++)
+					i->second->Clear();
 			}
+			else if (HUDScreen* screen = Find(screen_id))
+				screen->Clear();
 		}
 
 		///Change the font size for a specified screen (-1 = all)
-		void FontSize(PxReal font_size, unsigned int screen_id=-1)
+		void FontSize(PxReal font_size, int screen_id=-1)
 		{
 			if (screen_id == -1)
 			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					screens[i]->font_size = font_size;
-				}
-			}
-			else
-			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					if (screens[i]->id == screen_id)
-					{
-						screens[i]->font_size = font_size;
-						return;
-					}
-				}
+				for (unordered_map<int, HUDScreen*>::iterator i = screens.begin(); i != screens.end(); i++)
+					i->second->FontSize(font_size);
 			}
+			else if (HUDScreen* screen = Find(screen_id))
+				screen->FontSize(font_size);
 		}
 
 		///Change the color for a specified screen (-1 = all)
-		void Color(PxVec3 color, unsigned int screen_id=-1)
+		void Color(PxVec3 color, int screen_id=-1)
 		{
 			if (screen_id == -1)
 			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					screens[i]->color = color;
-				}
-			}
-			else
-			{
-				for (unsigned int i = 0; i < screens.size(); i++)
-				{
-					if (screens[i]->id == screen_id)
-					{
-						screens[i]->color = color;
-						return;
-					}
-				}
+				for (unordered_map<int, HUDScreen*>::iterator i = screens.begin(); i != screens.end(); i++)
+					i->second->Color(color);
 			}
+			else if (HUDScreen* screen = Find(screen_id))
+				screen->Color(color);
 		}
 
 		///Render the active screen
 		void Render()
 		{
-			for (unsigned int i = 0; i < screens.size(); i++)
-			{
-				if (screens[i]->id == active_screen)
-				{
-					screens[i]->Render();
-					return;
-				}
-			}
+			if (HUDScreen* screen = Find(active_screen))
+				screen->Render();
 		}
 	};
 }
\ No newline at end of file
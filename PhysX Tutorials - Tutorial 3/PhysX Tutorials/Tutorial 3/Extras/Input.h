@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+
+namespace VisualDebugger
+{
+	///Keys that are currently held down, with the time they were pressed.
+	///Regular keys are stored as 0..255 and special keys (GLUT_KEY_*) from SPECIAL_KEY on.
+	///The held keys are kept in a compact list, so going through them costs only as much as the keys actually held.
+	class Input
+	{
+	public:
+		static const int SPECIAL_KEY = 256;
+		static const int MAX_KEYS = 512;
+
+		struct HeldKey
+		{
+			int key;
+			//time of the press in seconds (see Now)
+			double time;
+		};
+
+	private:
+		std::vector<HeldKey> held;
+		//position of every key in held, -1 if it is not held
+		int slots[MAX_KEYS];
+
+	public:
+		Input()
+		{
+			for (int i = 0; i < MAX_KEYS; i++)
+				slots[i] = -1;
+		}
+
+		///Time stamp for input events in seconds (monotonic, the same on all threads)
+		static double Now()
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		///Add a held key, returns false if it is already held (e.g. auto-repeat)
+		bool Press(int key, double time)
+		{
+			if ((key < 0) || (key >= MAX_KEYS) || (slots[key] != -1))
+				return false;
+
+			HeldKey held_key = { key, time };
+			slots[key] = (int)held.size();
+			held.push_back(held_key);
+			return true;
+		}
+
+		///Remove a held key, returns false if it was not held
+		bool Release(int key)
+		{
+			if ((key < 0) || (key >= MAX_KEYS) || (slots[key] == -1))
+				return false;
+
+			//move the last key into the gap
+			int slot = slots[key];
+			held[slot] = held.back();
+			slots[held[slot].key] = slot;
+			held.pop_back();
+			slots[key] = -1;
+			return true;
+		}
+
+		///Is the key held down
+		bool IsHeld(int key) const
+		{
+			return (key >= 0) && (key < MAX_KEYS) && (slots[key] != -1);
+		}
+
+		///Number of held keys
+		unsigned int Count() const
+		{
+			return (unsigned int)held.size();
+		}
+
+		///Held key by position (0..Count()-1, in no particular order)
+		const HeldKey& Held(unsigned int index) const
+		{
+			return held[index];
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace VisualDebugger
+{
+	///Hands the latest value from one writer thread to one reader thread without locks.
+	///The writer fills Back() and publishes it, the reader picks up the newest published value with Front().
+	///Neither side ever waits: the third slot is always free for the writer.
+	template<class T>
+	class TripleBuffer
+	{
+		//set on the shared index when it holds a value the reader has not seen
+		static const unsigned int FRESH = 4;
+
+		T slots[3];
+		unsigned int back;
+		unsigned int front;
+		std::atomic<unsigned int> shared;
+
+	public:
+		TripleBuffer() : back(0), front(1), shared(2) {}
+
+		///Slot owned by the writer
+		T& Back() { return slots[back]; }
+
+		///Make the back slot the newest value and get a new back slot
+		void Publish()
+		{
+			back = shared.exchange(back | FRESH) & ~FRESH;
+		}
+
+		///Newest published value (the same one again if nothing new was published)
+		T& Front()
+		{
+			if (shared.load() & FRESH)
+				front = shared.exchange(front) & ~FRESH;
+			return slots[front];
+		}
+	};
+
+	///Fixed size queue between one producer thread and one consumer thread, without locks
+	template<class T, size_t N>
+	class SPSCQueue
+	{
+		T items[N];
+		std::atomic<size_t> head;
+		std::atomic<size_t> tail;
+
+	public:
+		SPSCQueue() : head(0), tail(0) {}
+
+		///Add an item (producer), returns false if the queue is full
+		bool Push(const T& item)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			size_t next = (t + 1) % N;
+			if (next == head.load(std::memory_order_acquire))
+				return false;
+			items[t] = item;
+			tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		///Remove the oldest item (consumer), returns false if the queue is empty
+		bool Pop(T& item)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+				return false;
+			item = items[h];
+			head.store((h + 1) % N, std::memory_order_release);
+			return true;
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,576 @@
+#include "MeshCache.h"
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+
+namespace VisualDebugger
+{
+	namespace MeshCache
+	{
+		///Identifies a unique piece of geometry: type and parameters, or the PhysX mesh
+		struct MeshKey
+		{
+			int type;
+			const void* mesh;
+			PxReal size[3];
+			int detail;
+
+			bool operator<(const MeshKey& other) const
+			{
+				return std::tie(type, mesh, size[0], size[1], size[2], detail) <
+					std::tie(other.type, other.mesh, other.size[0], other.size[1], other.size[2], other.detail);
+			}
+		};
+
+		///A display list and the source it was built from
+		struct CachedMesh
+		{
+			GLuint list;
+			//keeps the source (and its address as the key) alive while cached, empty for primitives
+			MeshSourcePtr source;
+		};
+
+		std::map<MeshKey, CachedMesh> meshes;
+
+		static float gPlaneData[]={
+			-1.f, 0.f, -1.f, 0.f, 1.f, 0.f, -1.f, 0.f, 1.f, 0.f, 1.f, 0.f,
+			1.f, 0.f, 1.f, 0.f, 1.f, 0.f, -1.f, 0.f, -1.f, 0.f, 1.f, 0.f,
+			1.f, 0.f, 1.f, 0.f, 1.f, 0.f, 1.f, 0.f, -1.f, 0.f, 1.f, 0.f
+		};
+
+		void DrawPlane()
+		{
+			glPushMatrix();
+			glScalef(10240,0,10240);
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glEnableClientState(GL_NORMAL_ARRAY);
+			glVertexPointer(3, GL_FLOAT, 2*3*sizeof(float), gPlaneData);
+			glNormalPointer(GL_FLOAT, 2*3*sizeof(float), gPlaneData+3);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			glDisableClientState(GL_VERTEX_ARRAY);
+			glDisableClientState(GL_NORMAL_ARRAY);
+			glPopMatrix();
+		}
+
+		///A capsule along the X axis, a sphere if half_height is 0
+		void BuildCapsule(MeshData& mesh, PxReal radius, PxReal half_height, int slices, int stacks)
+		{
+			//even number of stacks so that the equator is a ring of its own
+			stacks += stacks % 2;
+
+			//the equator ring is added twice: once for each hemisphere, the cylinder connects them
+			int rings = stacks + 2;
+			for (int i = 0; i < rings; i++)
+			{
+				int stack = (i <= stacks / 2) ? i : i - 1;
+				PxReal offset = (i <= stacks / 2) ? half_height : -half_height;
+				PxReal theta = PxPi * stack / stacks;
+				for (int j = 0; j <= slices; j++)
+				{
+					PxReal phi = 2.f * PxPi * j / slices;
+					PxVec3 n(PxCos(theta), PxSin(theta)*PxCos(phi), PxSin(theta)*PxSin(phi));
+					mesh.normals.push_back(n);
+					mesh.vertices.push_back(n*radius + PxVec3(offset, 0.f, 0.f));
+				}
+			}
+
+			for (int i = 0; i < rings - 1; i++)
+			{
+				for (int j = 0; j < slices; j++)
+				{
+					PxU32 i0 = i*(slices + 1) + j;
+					PxU32 i1 = i0 + slices + 1;
+					mesh.indices.push_back(i0);
+					mesh.indices.push_back(i0 + 1);
+					mesh.indices.push_back(i1);
+					mesh.indices.push_back(i1);
+					mesh.indices.push_back(i0 + 1);
+					mesh.indices.push_back(i1 + 1);
+				}
+			}
+		}
+
+		void BuildBox(MeshData& mesh, const PxVec3& half_size)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (int side = -1; side <= 1; side += 2)
+				{
+					PxVec3 n(0.f, 0.f, 0.f);
+					n[axis] = (PxReal)side;
+					PxVec3 u(0.f, 0.f, 0.f), v(0.f, 0.f, 0.f);
+					u[(axis + 1) % 3] = 1.f;
+					v[(axis + 2) % 3] = (PxReal)side;
+
+					PxU32 base = (PxU32)mesh.vertices.size();
+					PxVec3 corners[4] = { n - u - v, n + u - v, n + u + v, n - u + v };
+					for (int k = 0; k < 4; k++)
+					{
+						mesh.vertices.push_back(corners[k].multiply(half_size));
+						mesh.normals.push_back(n);
+					}
+					PxU32 quad[6] = { 0, 1, 2, 0, 2, 3 };
+					for (int k = 0; k < 6; k++)
+						mesh.indices.push_back(base + quad[k]);
+				}
+			}
+		}
+
+		///Hull polygons split into triangle fans, every polygon keeps its own vertices and plane normal
+		void BuildConvexMesh(MeshData& mesh, const PxConvexMesh* convex_mesh)
+		{
+			PxU32 num_polys = convex_mesh->getNbPolygons();
+			const PxVec3* verts = convex_mesh->getVertices();
+			const PxU8* indicies = convex_mesh->getIndexBuffer();
+
+			for (PxU32 i = 0; i < num_polys; i++)
+			{
+				PxHullPolygon face;
+				if (!convex_mesh->getPolygonData(i,face) || (face.mNbVerts < 3))
+					continue;
+
+				PxVec3 n(face.mPlane[0], face.mPlane[1], face.mPlane[2]);
+				const PxU8* faceIdx = indicies + face.mIndexBase;
+				PxU32 base = (PxU32)mesh.vertices.size();
+				for (PxU32 j = 0; j < face.mNbVerts; j++)
+				{
+					mesh.vertices.push_back(verts[faceIdx[j]]);
+					mesh.normals.push_back(n);
+				}
+				for (PxU32 j = 1; j + 1 < face.mNbVerts; j++)
+				{
+					mesh.indices.push_back(base);
+					mesh.indices.push_back(base + j);
+					mesh.indices.push_back(base + j + 1);
+				}
+			}
+		}
+
+		///Triangles with flat normals, vertices are not shared so that every face keeps its own normal
+		void BuildTriangleMesh(MeshData& mesh, const PxTriangleMesh* triangle_mesh)
+		{
+			const PxVec3* verts = triangle_mesh->getVertices();
+			const PxU32 num_trigs = triangle_mesh->getNbTriangles();
+			const void* trigs = triangle_mesh->getTriangles();
+			bool has_16bit_indices = triangle_mesh->getTriangleMeshFlags() & PxTriangleMeshFlag::eHAS_16BIT_TRIANGLE_INDICES;
+
+			mesh.vertices.resize(num_trigs*3);
+			mesh.normals.resize(num_trigs*3);
+			mesh.indices.resize(num_trigs*3);
+
+			for (PxU32 i = 0; i < num_trigs*3; i+=3)
+			{
+				for (PxU32 j = 0; j < 3; j++)
+				{
+					PxU32 index = has_16bit_indices ? ((const PxU16*)trigs)[i+j] : ((const PxU32*)trigs)[i+j];
+					mesh.vertices[i+j] = verts[index];
+					mesh.indices[i+j] = i+j;
+				}
+
+				PxVec3 n = (mesh.vertices[i+1]-mesh.vertices[i]).cross(mesh.vertices[i+2]-mesh.vertices[i]);
+				n.normalize();
+				mesh.normals[i] = mesh.normals[i+1] = mesh.normals[i+2] = n;
+			}
+		}
+
+		GLuint Compile(const MeshData& mesh)
+		{
+			GLuint list = glGenLists(1);
+			if (!list || !mesh.indices.size())
+				return list;
+
+			//vertex arrays are copied into the display list when it is compiled
+			glNewList(list, GL_COMPILE);
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glEnableClientState(GL_NORMAL_ARRAY);
+			glVertexPointer(3, GL_FLOAT, sizeof(PxVec3), &mesh.vertices.front());
+			glNormalPointer(GL_FLOAT, sizeof(PxVec3), &mesh.normals.front());
+			glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, &mesh.indices.front());
+			glDisableClientState(GL_NORMAL_ARRAY);
+			glDisableClientState(GL_VERTEX_ARRAY);
+			glEndList();
+
+			return list;
+		}
+
+		///Unscaled heights of every sample
+		void BuildHeights(MeshSource& source, const PxHeightField* heightfield)
+		{
+			source.rows = heightfield->getNbRows();
+			source.columns = heightfield->getNbColumns();
+			source.heights.resize(source.rows*source.columns);
+			for (PxU32 r = 0; r < source.rows; r++)
+			{
+				for (PxU32 c = 0; c < source.columns; c++)
+					source.heights[r*source.columns + c] = heightfield->getHeight((PxReal)r, (PxReal)c);
+			}
+		}
+
+		GLuint Build(const PxGeometryHolder& geometry, int detail, const MeshSource* source)
+		{
+			MeshData mesh;
+			GLuint list;
+
+			switch (geometry.getType())
+			{
+			case PxGeometryType::eSPHERE:
+				BuildCapsule(mesh, geometry.sphere().radius, 0.f, detail, detail);
+				return Compile(mesh);
+			case PxGeometryType::eCAPSULE:
+				BuildCapsule(mesh, geometry.capsule().radius, geometry.capsule().halfHeight, detail, detail);
+				return Compile(mesh);
+			case PxGeometryType::eBOX:
+				BuildBox(mesh, geometry.box().halfExtents);
+				return Compile(mesh);
+			case PxGeometryType::ePLANE:
+				list = glGenLists(1);
+				glNewList(list, GL_COMPILE);
+				DrawPlane();
+				glEndList();
+				return list;
+			case PxGeometryType::eCONVEXMESH:
+			case PxGeometryType::eTRIANGLEMESH:
+				return source ? Compile(source->mesh) : 0;
+			default:
+				return 0;
+			}
+		}
+
+		GLuint Get(const PxGeometryHolder& geometry, int detail, const MeshSourcePtr& source)
+		{
+			MeshKey key = { geometry.getType(), 0, { 0.f, 0.f, 0.f }, 0 };
+
+			switch (geometry.getType())
+			{
+			case PxGeometryType::eSPHERE:
+				key.size[0] = geometry.sphere().radius;
+				key.detail = detail;
+				break;
+			case PxGeometryType::eCAPSULE:
+				key.size[0] = geometry.capsule().radius;
+				key.size[1] = geometry.capsule().halfHeight;
+				key.detail = detail;
+				break;
+			case PxGeometryType::eBOX:
+				key.size[0] = geometry.box().halfExtents.x;
+				key.size[1] = geometry.box().halfExtents.y;
+				key.size[2] = geometry.box().halfExtents.z;
+				break;
+			case PxGeometryType::eCONVEXMESH:
+			case PxGeometryType::eTRIANGLEMESH:
+				if (!source)
+					return 0;
+				key.mesh = source.get();
+				break;
+			default:
+				break;
+			}
+
+			std::map<MeshKey, CachedMesh>::iterator it = meshes.find(key);
+			if (it != meshes.end())
+				return it->second.list;
+
+			CachedMesh& cached = meshes[key];
+			cached.list = Build(geometry, detail, source.get());
+			if (key.mesh)
+				cached.source = source;
+			return cached.list;
+		}
+
+		std::map<MeshKey, HeightFieldChunks> heightfields;
+
+		MeshKey HeightFieldKey(const PxHeightFieldGeometry& geometry, const MeshSource& source)
+		{
+			MeshKey key = { PxGeometryType::eHEIGHTFIELD, &source, { geometry.heightScale, geometry.rowScale, geometry.columnScale }, 0 };
+			return key;
+		}
+
+		///Scaled height of a sample, clamped to the grid
+		PxReal Height(const PxHeightFieldGeometry& geometry, const MeshSource& source, int row, int column)
+		{
+			row = PxClamp(row, 0, (int)source.rows - 1);
+			column = PxClamp(column, 0, (int)source.columns - 1);
+			return source.heights[row*source.columns + column] * geometry.heightScale;
+		}
+
+		HeightFieldChunks& GetHeightField(const PxHeightFieldGeometry& geometry, const MeshSourcePtr& source)
+		{
+			MeshKey key = HeightFieldKey(geometry, *source);
+			std::map<MeshKey, HeightFieldChunks>::iterator it = heightfields.find(key);
+			if (it != heightfields.end())
+				return it->second;
+
+			HeightFieldChunks& chunks = heightfields[key];
+			chunks.source = source;
+			PxU32 cell_rows = source->rows - 1;
+			PxU32 cell_columns = source->columns - 1;
+			chunks.rows = (cell_rows + heightfield_chunk_cells - 1) / heightfield_chunk_cells;
+			chunks.columns = (cell_columns + heightfield_chunk_cells - 1) / heightfield_chunk_cells;
+			chunks.lists.assign(chunks.rows*chunks.columns*heightfield_lods, 0);
+
+			for (PxU32 i = 0; i < chunks.rows; i++)
+			{
+				for (PxU32 j = 0; j < chunks.columns; j++)
+				{
+					PxU32 row_end = PxMin((i + 1)*heightfield_chunk_cells, cell_rows);
+					PxU32 column_end = PxMin((j + 1)*heightfield_chunk_cells, cell_columns);
+					PxReal min_height = PX_MAX_F32, max_height = -PX_MAX_F32;
+					for (PxU32 r = i*heightfield_chunk_cells; r <= row_end; r++)
+					{
+						for (PxU32 c = j*heightfield_chunk_cells; c <= column_end; c++)
+						{
+							PxReal height = Height(geometry, *source, r, c);
+							min_height = PxMin(min_height, height);
+							max_height = PxMax(max_height, height);
+						}
+					}
+
+					PxVec3 a(i*heightfield_chunk_cells*geometry.rowScale, min_height, j*heightfield_chunk_cells*geometry.columnScale);
+					PxVec3 b(row_end*geometry.rowScale, max_height, column_end*geometry.columnScale);
+					chunks.bounds.push_back(PxBounds3(a.minimum(b), a.maximum(b)));
+				}
+			}
+
+			return chunks;
+		}
+
+		///Grid of a single chunk with every step-th sample, plus skirts along the edges to hide cracks between levels
+		void BuildHeightFieldChunk(MeshData& mesh, const PxHeightFieldGeometry& geometry, const MeshSource& source,
+			PxU32 chunk_row, PxU32 chunk_column, int step, PxReal skirt)
+		{
+			PxU32 cell_rows = source.rows - 1;
+			PxU32 cell_columns = source.columns - 1;
+			PxU32 row_begin = chunk_row*heightfield_chunk_cells, row_end = PxMin(row_begin + heightfield_chunk_cells, cell_rows);
+			PxU32 column_begin = chunk_column*heightfield_chunk_cells, column_end = PxMin(column_begin + heightfield_chunk_cells, cell_columns);
+
+			//sample rows and columns, the last one always lies on the chunk edge
+			std::vector<PxU32> rows, columns;
+			for (PxU32 r = row_begin; r < row_end; r += step)
+				rows.push_back(r);
+			rows.push_back(row_end);
+			for (PxU32 c = column_begin; c < column_end; c += step)
+				columns.push_back(c);
+			columns.push_back(column_end);
+
+			PxU32 num_rows = (PxU32)rows.size(), num_columns = (PxU32)columns.size();
+			for (PxU32 i = 0; i < num_rows; i++)
+			{
+				for (PxU32 j = 0; j < num_columns; j++)
+				{
+					int r = rows[i], c = columns[j];
+					//normal from the full resolution neighbours
+					PxReal dx = (Height(geometry, source, r + 1, c) - Height(geometry, source, r - 1, c)) / (2.f*geometry.rowScale);
+					PxReal dz = (Height(geometry, source, r, c + 1) - Height(geometry, source, r, c - 1)) / (2.f*geometry.columnScale);
+					mesh.vertices.push_back(PxVec3(r*geometry.rowScale, Height(geometry, source, r, c), c*geometry.columnScale));
+					mesh.normals.push_back(PxVec3(-dx, 1.f, -dz).getNormalized());
+				}
+			}
+
+			for (PxU32 i = 0; i + 1 < num_rows; i++)
+			{
+				for (PxU32 j = 0; j + 1 < num_columns; j++)
+				{
+					PxU32 i0 = i*num_columns + j;
+					PxU32 i1 = i0 + num_columns;
+					mesh.indices.push_back(i0);
+					mesh.indices.push_back(i0 + 1);
+					mesh.indices.push_back(i1);
+					mesh.indices.push_back(i1);
+					mesh.indices.push_back(i0 + 1);
+					mesh.indices.push_back(i1 + 1);
+				}
+			}
+
+			//skirts: the edge vertices are repeated lower down and joined to the edge
+			PxU32 edges[4][2] = { { 0, 1 }, { (num_rows - 1)*num_columns, 1 }, { 0, num_columns }, { num_columns - 1, num_columns } };
+			PxU32 edge_lengths[4] = { num_columns, num_columns, num_rows, num_rows };
+			for (int e = 0; e < 4; e++)
+			{
+				PxU32 base = (PxU32)mesh.vertices.size();
+				for (PxU32 k = 0; k < edge_lengths[e]; k++)
+				{
+					PxU32 index = edges[e][0] + k*edges[e][1];
+					mesh.vertices.push_back(mesh.vertices[index] - PxVec3(0.f, skirt, 0.f));
+					mesh.normals.push_back(mesh.normals[index]);
+				}
+				for (PxU32 k = 0; k + 1 < edge_lengths[e]; k++)
+				{
+					PxU32 top0 = edges[e][0] + k*edges[e][1], top1 = top0 + edges[e][1];
+					mesh.indices.push_back(top0);
+					mesh.indices.push_back(top1);
+					mesh.indices.push_back(base + k);
+					mesh.indices.push_back(base + k);
+					mesh.indices.push_back(top1);
+					mesh.indices.push_back(base + k + 1);
+				}
+			}
+		}
+
+		GLuint GetHeightFieldChunk(const PxHeightFieldGeometry& geometry, const MeshSourcePtr& source, PxU32 chunk, int lod)
+		{
+			HeightFieldChunks& chunks = GetHeightField(geometry, source);
+			GLuint& list = chunks.lists[chunk*heightfield_lods + lod];
+			if (!list)
+			{
+				MeshData mesh;
+				int step = 1 << lod;
+				//deep enough to cover any gap with a neighbour of a different level
+				const PxBounds3& bounds = chunks.bounds[chunk];
+				PxReal skirt = PxMax(bounds.maximum.y - bounds.minimum.y, PxMax(PxAbs(geometry.rowScale), PxAbs(geometry.columnScale)));
+				BuildHeightFieldChunk(mesh, geometry, *source, chunk / chunks.columns, chunk % chunks.columns, step, skirt);
+				list = Compile(mesh);
+			}
+			return list;
+		}
+
+		///Collects the meshes that are released (on any thread), the source cache drops them on its own thread
+		class SourceCache::ReleaseListener : public PxDeletionListener
+		{
+			std::mutex mutex;
+			std::vector<const PxBase*> released;
+
+		public:
+			//set when released is not empty, checked without locking
+			std::atomic<bool> pending;
+
+			ReleaseListener() : pending(false) {}
+
+			void onRelease(const PxBase* observed, void*, PxDeletionEventFlag::Enum)
+			{
+				//only objects with a mesh source, not every actor, shape and material
+				switch (observed->getConcreteType())
+				{
+				case PxConcreteType::eCONVEX_MESH:
+				case PxConcreteType::eTRIANGLE_MESH:
+				case PxConcreteType::eHEIGHTFIELD:
+					break;
+				default:
+					return;
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				released.push_back(observed);
+				pending = true;
+			}
+
+			void Take(std::vector<const PxBase*>& objects)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				objects.swap(released);
+				released.clear();
+				pending = false;
+			}
+		};
+
+		SourceCache::SourceCache() : listener(new ReleaseListener())
+		{
+			PxGetPhysics().registerDeletionListener(*listener, PxDeletionEventFlag::eMEMORY_RELEASE);
+		}
+
+		SourceCache::~SourceCache()
+		{
+			PxGetPhysics().unregisterDeletionListener(*listener);
+			delete listener;
+		}
+
+		MeshSourcePtr SourceCache::Get(const PxGeometryHolder& geometry)
+		{
+			//a released mesh may share its address with a new one
+			if (listener->pending)
+			{
+				listener->Take(released);
+				for (PxU32 i = 0; i < released.size(); i++)
+					sources.erase(released[i]);
+			}
+
+			const PxBase* object;
+			switch (geometry.getType())
+			{
+			case PxGeometryType::eCONVEXMESH:
+				object = geometry.convexMesh().convexMesh;
+				break;
+			case PxGeometryType::eTRIANGLEMESH:
+				object = geometry.triangleMesh().triangleMesh;
+				break;
+			case PxGeometryType::eHEIGHTFIELD:
+				object = geometry.heightField().heightField;
+				break;
+			default:
+				return MeshSourcePtr();
+			}
+
+			MeshSourcePtr& source = sources[object];
+			if (!source)
+			{
+				std::shared_ptr<MeshSource> built = std::make_shared<MeshSource>();
+				built->rows = built->columns = 0;
+				switch (geometry.getType())
+				{
+				case PxGeometryType::eCONVEXMESH:
+					BuildConvexMesh(built->mesh, geometry.convexMesh().convexMesh);
+					break;
+				case PxGeometryType::eTRIANGLEMESH:
+					BuildTriangleMesh(built->mesh, geometry.triangleMesh().triangleMesh);
+					break;
+				default:
+					BuildHeights(*built, geometry.heightField().heightField);
+					break;
+				}
+				source = built;
+			}
+			return source;
+		}
+
+		void DeleteLists(const HeightFieldChunks& chunks)
+		{
+			for (PxU32 i = 0; i < chunks.lists.size(); i++)
+			{
+				if (chunks.lists[i])
+					glDeleteLists(chunks.lists[i], 1);
+			}
+		}
+
+		void CollectUnused()
+		{
+			//the cache holds the last reference once no snapshot uses the source any more
+			for (std::map<MeshKey, CachedMesh>::iterator it = meshes.begin(); it != meshes.end();)
+			{
+				if (it->second.source && (it->second.source.use_count() == 1))
+				{
+					if (it->second.list)
+						glDeleteLists(it->second.list, 1);
+					meshes.erase(it++);
+				}
+				else
+					++it;
+			}
+
+			for (std::map<MeshKey, HeightFieldChunks>::iterator it = heightfields.begin(); it != heightfields.end();)
+			{
+				if (it->second.source.use_count() == 1)
+				{
+					DeleteLists(it->second);
+					heightfields.erase(it++);
+				}
+				else
+					++it;
+			}
+		}
+
+		void Release()
+		{
+			for (std::map<MeshKey, CachedMesh>::iterator it = meshes.begin(); it != meshes.end(); ++it)
+			{
+				if (it->second.list)
+					glDeleteLists(it->second.list, 1);
+			}
+			meshes.clear();
+
+			for (std::map<MeshKey, HeightFieldChunks>::iterator it = heightfields.begin(); it != heightfields.end(); ++it)
+				DeleteLists(it->second);
+			heightfields.clear();
+		}
+	}
+}
\ No newline at end of file
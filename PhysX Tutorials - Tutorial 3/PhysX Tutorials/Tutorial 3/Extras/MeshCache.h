@@ -0,0 +1,99 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+#include <GL/glut.h>
+#include <vector>
+#include <map>
+#include <memory>
+
+namespace VisualDebugger
+{
+	namespace MeshCache
+	{
+		using namespace physx;
+
+		///Triangle mesh data ready to be uploaded
+		struct MeshData
+		{
+			std::vector<PxVec3> vertices;
+			std::vector<PxVec3> normals;
+			std::vector<PxU32> indices;
+		};
+
+		///Copy of what the renderer needs from a convex mesh, triangle mesh or heightfield.
+		///It is made on the simulation thread and shared by the snapshots,
+		///so the render thread never reads a PhysX mesh that may have been released in the meantime.
+		struct MeshSource
+		{
+			//triangles with flat normals (convex and triangle meshes)
+			MeshData mesh;
+			//unscaled heights of a heightfield, row by row
+			PxU32 rows, columns;
+			std::vector<PxReal> heights;
+		};
+
+		typedef std::shared_ptr<const MeshSource> MeshSourcePtr;
+
+		///Mesh sources of a single simulation thread, built once for every PhysX mesh
+		///and dropped when the mesh is released.
+		class SourceCache
+		{
+			class ReleaseListener;
+			ReleaseListener* listener;
+			std::map<const PxBase*, MeshSourcePtr> sources;
+			//reused between steps
+			std::vector<const PxBase*> released;
+
+		public:
+			///Start watching for released meshes, the PhysX SDK must outlive the cache
+			SourceCache();
+
+			~SourceCache();
+
+			SourceCache(const SourceCache&) = delete;
+			SourceCache& operator=(const SourceCache&) = delete;
+
+			///Source of a mesh or heightfield geometry, empty for any other geometry.
+			///Only the thread that owns the cache may call it.
+			MeshSourcePtr Get(const PxGeometryHolder& geometry);
+		};
+
+		///Get the display list for a geometry. It is built on the first call with
+		///the same geometry type and parameters (or mesh source) and reused afterwards.
+		///Meshes are built from their source, the geometry only gives the type and size.
+		///Returns 0 for unsupported geometry.
+		GLuint Get(const PxGeometryHolder& geometry, int detail, const MeshSourcePtr& source);
+
+		///Compile triangle mesh data into a display list
+		GLuint Compile(const MeshData& mesh);
+
+		///Heightfields are split into square chunks of cells that are culled
+		///and tessellated separately, every level of detail halves the resolution.
+		const PxU32 heightfield_chunk_cells = 32;
+		const int heightfield_lods = 4;
+
+		///Chunks of a heightfield
+		struct HeightFieldChunks
+		{
+			PxU32 rows, columns;
+			//local bounds of every chunk
+			std::vector<PxBounds3> bounds;
+			//display lists: chunk*heightfield_lods + lod, 0 until built
+			std::vector<GLuint> lists;
+			//keeps the samples (and their address as the key) alive while cached
+			MeshSourcePtr source;
+		};
+
+		///Get the chunks of a heightfield (the bounds are computed on the first call)
+		HeightFieldChunks& GetHeightField(const PxHeightFieldGeometry& geometry, const MeshSourcePtr& source);
+
+		///Get the display list of a single heightfield chunk, it is built on the first call
+		GLuint GetHeightFieldChunk(const PxHeightFieldGeometry& geometry, const MeshSourcePtr& source, PxU32 chunk, int lod);
+
+		///Drop the meshes whose source is no longer held by any snapshot (render thread only)
+		void CollectUnused();
+
+		///Release all cached meshes
+		void Release();
+	}
+}
\ No newline at end of file
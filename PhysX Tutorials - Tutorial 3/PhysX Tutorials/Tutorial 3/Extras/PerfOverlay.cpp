@@ -0,0 +1,169 @@
+#include "PerfOverlay.h"
+#include "Renderer.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+//Replacing the global operator new affects the whole application, it is only done
+//when COUNT_HEAP_ALLOCATIONS is defined (e.g. in the project's preprocessor definitions).
+//The overlay counts PhysX allocations only otherwise.
+#ifdef COUNT_HEAP_ALLOCATIONS
+//count every heap allocation of the application
+std::atomic<physx::PxU32> heap_allocation_count(0);
+
+void* operator new(size_t size)
+{
+	heap_allocation_count++;
+	void* memory = malloc(size ? size : 1);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	heap_allocation_count++;
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	free(memory);
+}
+#endif
+
+namespace VisualDebugger
+{
+	bool HeapAllocationsCounted()
+	{
+#ifdef COUNT_HEAP_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	PxU32 HeapAllocations()
+	{
+#ifdef COUNT_HEAP_ALLOCATIONS
+		return heap_allocation_count;
+#else
+		return 0;
+#endif
+	}
+
+	static const PxVec3 graph_colors[PerfOverlay::GRAPH_COUNT] =
+	{
+		PxVec3(1.f, 1.f, 1.f),
+		PxVec3(1.f, .6f, .2f),
+		PxVec3(.3f, .8f, 1.f),
+		PxVec3(.6f, 1.f, .4f)
+	};
+
+	static const char* graph_names[PerfOverlay::GRAPH_COUNT] =
+	{
+		"frame",
+		"sim step",
+		"render",
+		"hud"
+	};
+
+	PerfOverlay::PerfOverlay()
+		: frame_index(0), step_index(0), draw_calls(0), heap_allocations(0), physx_allocations(0)
+	{
+		for (int i = 0; i < GRAPH_COUNT; i++)
+		{
+			for (PxU32 j = 0; j < history; j++)
+				graphs[i][j] = 0.f;
+		}
+		last_step.step_time = 0.f;
+		last_step.actors = last_step.active_bodies = last_step.contacts = 0;
+	}
+
+	void PerfOverlay::AddFrame(PxReal frame_time, PxReal render_time, PxReal hud_time,
+		PxU32 _draw_calls, PxU32 _heap_allocations, PxU32 _physx_allocations)
+	{
+		graphs[FRAME_TIME][frame_index] = frame_time;
+		graphs[RENDER_TIME][frame_index] = render_time;
+		graphs[HUD_TIME][frame_index] = hud_time;
+		frame_index = (frame_index + 1) % history;
+
+		draw_calls = _draw_calls;
+		heap_allocations = _heap_allocations;
+		physx_allocations = _physx_allocations;
+	}
+
+	void PerfOverlay::AddStep(const StepSample& sample)
+	{
+		graphs[STEP_TIME][step_index] = sample.step_time;
+		step_index = (step_index + 1) % history;
+		last_step = sample;
+	}
+
+	PxReal PerfOverlay::Max(Graph graph)
+	{
+		PxReal value = 0.f;
+		for (PxU32 i = 0; i < history; i++)
+			value = PxMax(value, graphs[graph][i]);
+		return value;
+	}
+
+	void PerfOverlay::Render()
+	{
+		const PxReal font_size = 0.018f;
+		const PxVec3 text_color(0.f, 0.f, 0.f);
+		const PxVec2 graph_size(0.4f, 0.1f);
+		PxVec2 location(0.58f, 0.95f);
+
+		//counters of the last frame and step
+		sprintf_s(text, "actors %u   active bodies %u   contacts %u", last_step.actors, last_step.active_bodies, last_step.contacts);
+		Renderer::RenderText(text, location, text_color, font_size);
+		location.y -= font_size;
+		if (HeapAllocationsCounted())
+			sprintf_s(text, "draw calls %u   allocations heap %u  physx %u", draw_calls, heap_allocations, physx_allocations);
+		else
+			sprintf_s(text, "draw calls %u   allocations heap n/a  physx %u", draw_calls, physx_allocations);
+		Renderer::RenderText(text, location, text_color, font_size);
+		location.y -= font_size;
+
+		//graphs share the scale of a 60 Hz frame until something takes longer
+		for (int i = 0; i < GRAPH_COUNT; i++)
+		{
+			Graph graph = (Graph)i;
+			PxU32 first = (graph == STEP_TIME) ? step_index : frame_index;
+			PxReal latest = graphs[graph][(first + history - 1) % history];
+			PxReal max_value = Max(graph);
+
+			location.y -= graph_size.y + font_size*1.5f;
+			Renderer::RenderGraph(graphs[graph], history, first, PxMax(max_value, 1000.f / 60.f), location, graph_size, graph_colors[i]);
+			sprintf_s(text, "%s %.2f ms (max %.2f)", graph_names[i], latest, max_value);
+			Renderer::RenderText(text, PxVec2(location.x, location.y + graph_size.y + font_size*0.25f), text_color, font_size);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "PxPhysicsAPI.h"
+
+namespace VisualDebugger
+{
+	using namespace physx;
+
+	///True if the build counts heap allocations (COUNT_HEAP_ALLOCATIONS is defined)
+	bool HeapAllocationsCounted();
+
+	///Number of heap allocations (operator new) so far, from all threads, 0 if they are not counted
+	PxU32 HeapAllocations();
+
+	///Timing and counters of a single simulation step
+	struct StepSample
+	{
+		//duration of the step in ms
+		PxReal step_time;
+		PxU32 actors;
+		PxU32 active_bodies;
+		PxU32 contacts;
+	};
+
+	///Rolling graphs of frame, simulation step, render and HUD times with counters for the last frame.
+	///The history is kept in fixed arrays and the text in a fixed buffer, so neither adding samples nor rendering allocates.
+	class PerfOverlay
+	{
+	public:
+		///Number of samples shown in every graph
+		static const PxU32 history = 240;
+
+		enum Graph
+		{
+			FRAME_TIME,
+			STEP_TIME,
+			RENDER_TIME,
+			HUD_TIME,
+			GRAPH_COUNT
+		};
+
+	private:
+		//ring buffers, the frame graphs advance with every frame and the step graph with every step
+		PxReal graphs[GRAPH_COUNT][history];
+		PxU32 frame_index;
+		PxU32 step_index;
+
+		StepSample last_step;
+		PxU32 draw_calls;
+		PxU32 heap_allocations;
+		PxU32 physx_allocations;
+
+		char text[128];
+
+		PxReal Max(Graph graph);
+
+	public:
+		PerfOverlay();
+
+		///Add the timing (in ms) and counters of a frame
+		void AddFrame(PxReal frame_time, PxReal render_time, PxReal hud_time,
+			PxU32 draw_calls, PxU32 heap_allocations, PxU32 physx_allocations);
+
+		///Add a simulation step of the observed scene
+		void AddStep(const StepSample& sample);
+
+		///Render the graphs and counters over the window
+		void Render();
+	};
+}
\ No newline at end of file
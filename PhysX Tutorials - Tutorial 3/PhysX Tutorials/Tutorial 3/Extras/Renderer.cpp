@@ -1,10 +1,40 @@
 #include "Renderer.h"
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include "UserData.h"
+#include "MeshCache.h"
 
 using namespace std;
 
+//depth texture comparison (GL_ARB_depth_texture, GL_ARB_shadow), missing from the GL 1.1 headers
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_DEPTH_TEXTURE_MODE_ARB
+#define GL_DEPTH_TEXTURE_MODE_ARB 0x884B
+#endif
+#ifndef GL_TEXTURE_COMPARE_MODE_ARB
+#define GL_TEXTURE_COMPARE_MODE_ARB 0x884C
+#endif
+#ifndef GL_TEXTURE_COMPARE_FUNC_ARB
+#define GL_TEXTURE_COMPARE_FUNC_ARB 0x884D
+#endif
+#ifndef GL_COMPARE_R_TO_TEXTURE_ARB
+#define GL_COMPARE_R_TO_TEXTURE_ARB 0x884E
+#endif
+//BGRA colour arrays (GL_ARB_vertex_array_bgra)
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+
 namespace VisualDebugger
 {
 	namespace Renderer
@@ -13,203 +43,337 @@ namespace VisualDebugger
 		PxVec3 background_color = PxVec3(0.f,0.f,0.f);
 		int render_detail = 10;
 		bool show_shadows = true;
+		int viewport_x = 0, viewport_y = 0, viewport_width = 1, viewport_height = 1;
+		int window_width = 1, window_height = 1;
+		PxU32 draw_calls = 0;
+		//frame pacing
+		typedef std::chrono::steady_clock PacingClock;
+		PxReal target_fps = 60.f;
+		PxReal idle_fps = 10.f;
+		bool idle = false;
+		bool redraw_requested = true;
+		bool (*changed_func)() = 0;
+		PacingClock::time_point last_frame = PacingClock::now();
+		PxVec3 camera_eye = PxVec3(0.f, 0.f, 0.f);
+		const PxReal field_of_view = 60.f;
+		//view frustum planes (normal, distance) in world space, facing inwards
+		PxVec4 frustum[6];
+		const PxVec3 shadowDir(-0.7071067f, -0.7071067f, -0.7071067f);
+
+		//shadow map
+		bool shadows_supported = false;
+		GLuint shadow_texture = 0;
+		int shadow_map_size = 0;
+		const int max_shadow_map_size = 2048;
+		PxMat44 light_projection, light_view;
+
+		//debug colours can be read straight from PhysX (packed ARGB is BGRA in memory)
+		bool bgra_colors_supported = false;
+		//swizzled colours when they can not
+		std::vector<PxU32> debug_colors;
+
+		//tessellation levels for spheres and capsules, picked by the projected size
+		const int detail_levels[] = { 6, 10, 16, 24, 40, 64 };
+		const int num_detail_levels = sizeof(detail_levels) / sizeof(detail_levels[0]);
+
+		///Choose the tessellation of a round shape from its size on the screen (never above render_detail)
+		int DetailLevel(const PxVec3& center, PxReal radius)
+		{
+			PxReal distance = (center - camera_eye).magnitude();
+			if (distance <= radius)
+				return render_detail;
 
-		static float gPlaneData[]={
-			-1.f, 0.f, -1.f, 0.f, 1.f, 0.f, -1.f, 0.f, 1.f, 0.f, 1.f, 0.f,
-			1.f, 0.f, 1.f, 0.f, 1.f, 0.f, -1.f, 0.f, -1.f, 0.f, 1.f, 0.f,
-			1.f, 0.f, 1.f, 0.f, 1.f, 0.f, 1.f, 0.f, -1.f, 0.f, 1.f, 0.f
-		};
+			//projected radius in pixels, about one slice for every 2 pixels of the circumference
+			PxReal pixels = radius / (distance * PxTan(PxPi * field_of_view / 360.f)) * viewport_height * .5f;
+			//circumference 2*pi*pixels, halved
+			int slices = (int)(PxPi * pixels);
 
-		void DrawPlane()
+			for (int i = 0; i < num_detail_levels; i++)
+			{
+				if (detail_levels[i] >= render_detail)
+					break;
+				if (detail_levels[i] >= slices)
+					return detail_levels[i];
+			}
+			return render_detail;
+		}
+
+		///Extract the frustum planes from the current projection and modelview matrices
+		void UpdateFrustum()
 		{
-			glScalef(10240,0,10240);
-			glEnableClientState(GL_VERTEX_ARRAY);
-			glEnableClientState(GL_NORMAL_ARRAY);
-			glVertexPointer(3, GL_FLOAT, 2*3*sizeof(float), gPlaneData);
-			glNormalPointer(GL_FLOAT, 2*3*sizeof(float), gPlaneData+3);
-			glDrawArrays(GL_TRIANGLES, 0, 6);
-			glDisableClientState(GL_VERTEX_ARRAY);
-			glDisableClientState(GL_NORMAL_ARRAY);
+			PxMat44 projection, modelview;
+			glGetFloatv(GL_PROJECTION_MATRIX, (float*)&projection);
+			glGetFloatv(GL_MODELVIEW_MATRIX, (float*)&modelview);
+			//columns of the transposed matrix are the rows of the clip matrix
+			PxMat44 clip = (projection * modelview).getTranspose();
+
+			for (unsigned int i = 0; i < 3; i++)
+			{
+				frustum[i*2] = PxVec4(clip[3].x + clip[i].x, clip[3].y + clip[i].y, clip[3].z + clip[i].z, clip[3].w + clip[i].w);
+				frustum[i*2+1] = PxVec4(clip[3].x - clip[i].x, clip[3].y - clip[i].y, clip[3].z - clip[i].z, clip[3].w - clip[i].w);
+			}
 		}
 
-		void DrawSphere(const PxGeometryHolder& geometry)
+		///Test if the bounds are (at least partially) inside the view frustum
+		bool InFrustum(const PxBounds3& bounds)
 		{
-			glutSolidSphere(geometry.sphere().radius, render_detail, render_detail);
+			PxVec3 center = bounds.getCenter();
+			PxVec3 extents = bounds.getExtents();
+			for (unsigned int i = 0; i < 6; i++)
+			{
+				PxVec3 normal = frustum[i].getXYZ();
+				if (normal.dot(center) + frustum[i].w + extents.dot(normal.abs()) < 0.f)
+					return false;
+			}
+			return true;
 		}
 
-		void DrawBox(const PxGeometryHolder& geometry)
+		///Bounds of the shadow cast by the bounds onto the ground (along shadowDir)
+		PxBounds3 ShadowBounds(const PxBounds3& bounds)
 		{
-			PxVec3 half_size = geometry.box().halfExtents;
-			glScalef(half_size.x, half_size.y, half_size.z);
-			glutSolidCube(2.f);		
+			PxVec3 center = bounds.getCenter();
+			PxVec3 extents = bounds.getExtents();
+			PxReal sx = -shadowDir.x/shadowDir.y, sz = -shadowDir.z/shadowDir.y;
+			return PxBounds3::centerExtents(PxVec3(center.x + sx*center.y, 0.f, center.z + sz*center.y),
+				PxVec3(extents.x + PxAbs(sx)*extents.y, 0.f, extents.z + PxAbs(sz)*extents.y));
 		}
 
-		void DrawCapsule(const PxGeometryHolder& geometry)
+		///Threads that stay alive between frames and split ranges of work with the calling thread
+		class TaskPool
 		{
-			const PxF32 radius = geometry.capsule().radius;
-			const PxF32 halfHeight = geometry.capsule().halfHeight;
+			typedef void (*Job)(void* task, PxU32 begin, PxU32 end);
+
+			std::vector<std::thread> threads;
+			std::mutex mutex;
+			std::condition_variable wake_up;
+			std::condition_variable finished;
+			bool quit;
+			//the current job, set under the mutex, every thread takes chunks of it until none are left
+			Job job;
+			void* task;
+			PxU32 count;
+			PxU32 chunk;
+			std::atomic<PxU32> next_chunk;
+			//bumped for every job, threads that are still running the job
+			PxU32 generation;
+			PxU32 busy;
+
+			void RunChunks()
+			{
+				for (PxU32 begin = next_chunk++ * chunk; begin < count; begin = next_chunk++ * chunk)
+					job(task, begin, PxMin(begin + chunk, count));
+			}
 
-			//Sphere
-			glPushMatrix();
-			glTranslatef(halfHeight,0.f, 0.f);
-			glutSolidSphere(radius, render_detail, render_detail);		
-			glPopMatrix();
+			//seen is the generation when the thread was started, a job posted before it gets the mutex is not missed
+			void Worker(PxU32 seen)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true)
+				{
+					wake_up.wait(lock, [&] { return quit || (generation != seen); });
+					if (quit)
+						return;
+					seen = generation;
+
+					lock.unlock();
+					RunChunks();
+					lock.lock();
+					if (--busy == 0)
+						finished.notify_one();
+				}
+			}
 
-			//Sphere
-			glPushMatrix();
-			glTranslatef(-halfHeight,0.f,0.f);
-			glutSolidSphere(radius, render_detail, render_detail);		
-			glPopMatrix();
+		public:
+			TaskPool() : quit(false), job(0), task(0), count(0), chunk(1), next_chunk(0), generation(0), busy(0) {}
 
-			//Cylinder
-			glPushMatrix();
-			glTranslatef(-halfHeight,0.f,0.f);
-			glRotatef(90.f,0.f,1.f,0.f);
+			~TaskPool()
+			{
+				Stop();
+			}
 
-			GLUquadric* qobj = gluNewQuadric();
-			gluQuadricNormals(qobj, GLU_SMOOTH);
-			gluCylinder(qobj, radius, radius, halfHeight*2.f, render_detail, render_detail);
-			gluDeleteQuadric(qobj);
-			glPopMatrix();
-		}
+			///Number of threads besides the calling one (started on the first call)
+			PxU32 Workers()
+			{
+				if (threads.empty())
+				{
+					PxU32 num_threads = PxMax(std::thread::hardware_concurrency(), 1u) - 1;
+					for (PxU32 i = 0; i < num_threads; i++)
+						threads.push_back(std::thread(&TaskPool::Worker, this, generation));
+				}
+				return (PxU32)threads.size();
+			}
 
-		void DrawConvexMesh(const PxGeometryHolder& geometry)
-		{
-			PxConvexMesh* mesh = geometry.convexMesh().convexMesh;
-			PxU32 num_polys = mesh->getNbPolygons();
-			const PxVec3* verts = mesh->getVertices();
-			const PxU8* indicies = mesh->getIndexBuffer();
+			///Run job(task, begin, end) over [0, _count) in chunks and wait until all are done
+			void Run(PxU32 _count, PxU32 _chunk, Job _job, void* _task)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					job = _job;
+					task = _task;
+					count = _count;
+					chunk = _chunk;
+					next_chunk = 0;
+					busy = (PxU32)threads.size();
+					generation++;
+				}
+				wake_up.notify_all();
+				RunChunks();
+
+				std::unique_lock<std::mutex> lock(mutex);
+				finished.wait(lock, [&] { return busy == 0; });
+			}
 
-			for (PxU32 i = 0; i < num_polys; i++)
+			void Stop()
 			{
-				PxHullPolygon face;
-				if (mesh->getPolygonData(i,face))
 				{
-					glBegin(GL_POLYGON);
-					glNormal3f(face.mPlane[0],face.mPlane[1],face.mPlane[2]);
-					const PxU8* faceIdx = indicies + face.mIndexBase;
-					for (PxU32 j = 0; j < face.mNbVerts; j++)
-					{
-						PxVec3 v = verts[faceIdx[j]];
-						glVertex3f(v.x,v.y,v.z);
-					}
-					glEnd();
+					std::lock_guard<std::mutex> lock(mutex);
+					quit = true;
 				}
+				wake_up.notify_all();
+				for (PxU32 i = 0; i < threads.size(); i++)
+					threads[i].join();
+				threads.clear();
+				quit = false;
 			}
-		}
+		};
+
+		TaskPool task_pool;
 
-		void DrawTriangleMesh(const PxGeometryHolder& geometry)
+		template<class Task>
+		void RunTask(void* task, PxU32 begin, PxU32 end)
 		{
-			PxTriangleMesh* mesh = geometry.triangleMesh().triangleMesh;
-			const PxVec3* verts = mesh->getVertices();
-			PxU16* trigs = (PxU16*)mesh->getTriangles();
-			const PxU32 num_trigs = mesh->getNbTriangles();
+			(*(Task*)task)(begin, end);
+		}
 
-			for (PxU32 i = 0; i < num_trigs*3; i+=3)
+		///Run task(begin, end) over [0, count), split between the pool threads when the range is large
+		template<class Task>
+		void ParallelFor(PxU32 count, Task task)
+		{
+			//smaller ranges are not worth waking up the pool
+			const PxU32 min_chunk = 4096;
+			PxU32 workers = (count > min_chunk) ? task_pool.Workers() : 0;
+			if (!workers)
 			{
-				PxVec3 v0 = verts[trigs[i]];
-				PxVec3 v1 = verts[trigs[i+1]];
-				PxVec3 v2 = verts[trigs[i+2]];
-				PxVec3 n = (v1-v0).cross(v2-v0);
-				n.normalize();
-				glBegin(GL_POLYGON);
-				glNormal3f(n.x, n.y, n.z);
-				glVertex3f(v0.x, v0.y, v0.z);
-				glVertex3f(v1.x, v1.y, v1.z);
-				glVertex3f(v2.x, v2.y, v2.z);
-				glEnd();
+				task(0, count);
+				return;
 			}
+
+			PxU32 chunk = PxMax(min_chunk, (count + workers) / (workers + 1));
+			task_pool.Run(count, chunk, &RunTask<Task>, &task);
 		}
 
-		void DrawHeightField(const PxGeometryHolder& geometry)
+		///Normals of a cloth, kept between frames
+		struct ClothBuffers
 		{
-			//TODO
-		}
+			//the adjacency below is rebuilt when the quads change
+			std::vector<PxU32> quads;
+			//Finish count when the cloth was last drawn
+			PxU32 last_drawn;
+			std::vector<PxVec3> face_normals;
+			std::vector<PxVec3> normals;
+			//quads around every particle: quad_offsets[i]..quad_offsets[i+1] in particle_quads
+			std::vector<PxU32> quad_offsets;
+			std::vector<PxU32> particle_quads;
+		};
 
-		void RenderGeometry(const PxGeometryHolder& geometry)
+		std::map<const PxCloth*, ClothBuffers> cloth_buffers;
+		PxU32 finish_count = 0;
+		//cloths not drawn for this many Finish calls are dropped
+		const PxU32 cloth_buffer_lifetime = 120;
+		///Drop everything cached for meshes and cloths that are no longer drawn
+		void CollectReleased()
 		{
-			switch(geometry.getType())
+			MeshCache::CollectUnused();
+			for (std::map<const PxCloth*, ClothBuffers>::iterator it = cloth_buffers.begin(); it != cloth_buffers.end();)
 			{
-			case PxGeometryType::ePLANE:
-				DrawPlane();
-				break;
-			case PxGeometryType::eSPHERE:
-				DrawSphere(geometry);
-				break;
-			case PxGeometryType::eBOX:			
-				DrawBox(geometry);
-				break;
-			case PxGeometryType::eCAPSULE:
-				DrawCapsule(geometry);
-				break;
-			case PxGeometryType::eCONVEXMESH:
-				DrawConvexMesh(geometry);
-				break;
-			case PxGeometryType::eTRIANGLEMESH:
-				DrawTriangleMesh(geometry);
-				break;
-			case PxGeometryType::eHEIGHTFIELD:
-				DrawHeightField(geometry);
-				break;
-			default:
-				break;
+				if (finish_count - it->second.last_drawn > cloth_buffer_lifetime)
+					cloth_buffers.erase(it++);
+				else
+					++it;
 			}
 		}
 
-		void RenderCloth(const PxCloth* cloth)
+		///Build the particle to quad adjacency (again whenever the quads change)
+		void InitClothBuffers(ClothBuffers& buffers, const std::vector<PxU32>& cloth_quads, PxU32 particle_count)
 		{
-			PxClothMeshDesc* mesh_desc = ((UserData*)cloth->userData)->cloth_mesh_desc;
-			PxVec3* color = ((UserData*)cloth->userData)->color;
-
-			PxU32 quad_count = mesh_desc->quads.count;
-			PxU32* quads = (PxU32*)mesh_desc->quads.data;
-
-			std::vector<PxVec3> verts(cloth->getNbParticles());
-			std::vector<PxVec3> norms(verts.size(), PxVec3(0.f,0.f,0.f));
-
-			//get verts data
-			cloth->lockParticleData();
+			buffers.quads = cloth_quads;
+			const PxU32* quads = &buffers.quads.front();
+			PxU32 quad_count = (PxU32)buffers.quads.size() / 4;
+
+			buffers.face_normals.resize(quad_count);
+			buffers.normals.resize(particle_count);
+			buffers.quad_offsets.assign(particle_count + 1, 0);
+			buffers.particle_quads.resize(quad_count*4);
+
+			for (PxU32 i = 0; i < quad_count*4; i++)
+				buffers.quad_offsets[quads[i] + 1]++;
+			for (PxU32 i = 0; i < particle_count; i++)
+				buffers.quad_offsets[i + 1] += buffers.quad_offsets[i];
+
+			std::vector<PxU32> fill(buffers.quad_offsets.begin(), buffers.quad_offsets.end() - 1);
+			for (PxU32 i = 0; i < quad_count*4; i++)
+				buffers.particle_quads[fill[quads[i]]++] = i / 4;
+		}
 
-			PxClothParticleData* particle_data = cloth->lockParticleData();
-			if (!particle_data)
+		void RenderCloth(const ClothSnapshot& cloth)
+		{
+			const PxU32 quad_count = (PxU32)cloth.quads.size() / 4;
+			const PxU32 particle_count = (PxU32)cloth.particles.size();
+			if (!quad_count || !particle_count)
 				return;
-			// copy vertex positions
-			for (PxU32 j = 0; j < verts.size(); j++)
-				verts[j] = particle_data->particles[j].pos;
 
-			particle_data->unlock();
+			//a new cloth at the address of a released one has other quads
+			ClothBuffers& buffers = cloth_buffers[cloth.cloth];
+			if ((buffers.normals.size() != particle_count) || (buffers.quads != cloth.quads))
+				InitClothBuffers(buffers, cloth.quads, particle_count);
+			buffers.last_drawn = finish_count;
+
+			const PxU32* quads = &buffers.quads.front();
+			const PxVec3* particles = &cloth.particles.front();
 
-			for (PxU32 i = 0; i < quad_count*4; i+=4)
+			//face pass
+			PxVec3* face_normals = &buffers.face_normals.front();
+			ParallelFor(quad_count, [=](PxU32 begin, PxU32 end)
 			{
-				PxVec3 v0 = verts[quads[i]];
-				PxVec3 v1 = verts[quads[i+1]];
-				PxVec3 v2 = verts[quads[i+2]];
-				PxVec3 n = -((v1-v0).cross(v2-v0));
-
-				norms[quads[i]] += n;
-				norms[quads[i+1]] += n;
-				norms[quads[i+2]] += n;
-				norms[quads[i+3]] += n;
-			}
+				for (PxU32 i = begin; i < end; i++)
+				{
+					const PxU32* quad = quads + i*4;
+					PxVec3 v0 = particles[quad[0]];
+					face_normals[i] = -((particles[quad[1]]-v0).cross(particles[quad[2]]-v0));
+				}
+			});
 
-			for (PxU32 i = 0; i < norms.size(); i++)
-				norms[i].normalize();
+			//vertex pass, every particle gathers the normals of its own quads
+			PxVec3* normals = &buffers.normals.front();
+			const PxU32* quad_offsets = &buffers.quad_offsets.front();
+			const PxU32* particle_quads = buffers.particle_quads.size() ? &buffers.particle_quads.front() : 0;
+			ParallelFor(particle_count, [=](PxU32 begin, PxU32 end)
+			{
+				for (PxU32 i = begin; i < end; i++)
+				{
+					PxVec3 n(0.f, 0.f, 0.f);
+					for (PxU32 j = quad_offsets[i]; j < quad_offsets[i+1]; j++)
+						n += face_normals[particle_quads[j]];
+					n.normalize();
+					normals[i] = n;
+				}
+			});
 
-			PxTransform pose = cloth->getGlobalPose();
-			PxMat44 shapePose(pose);
+			PxMat44 shapePose(cloth.pose);
 
-			glColor4f(color->x, color->y, color->z, 1.f);
+			glColor4f(cloth.color.x, cloth.color.y, cloth.color.z, 1.f);
 
-			glPushMatrix();						
+			glPushMatrix();
 			glMultMatrixf((float*)&shapePose);
 
 			glEnableClientState(GL_VERTEX_ARRAY);
 			glEnableClientState(GL_NORMAL_ARRAY);
 
-			glVertexPointer(3, GL_FLOAT, sizeof(PxVec3), &verts.front());
-			glNormalPointer(GL_FLOAT, sizeof(PxVec3), &norms.front());
+			glVertexPointer(3, GL_FLOAT, sizeof(PxVec3), particles);
+			glNormalPointer(GL_FLOAT, sizeof(PxVec3), normals);
 
 			glDrawElements(GL_QUADS, quad_count*4, GL_UNSIGNED_INT, quads);
+			draw_calls++;
 
 			glDisableClientState(GL_NORMAL_ARRAY);
 			glDisableClientState(GL_VERTEX_ARRAY);
@@ -219,11 +383,35 @@ namespace VisualDebugger
 
 		void reshapeCallback(int width, int height)
 		{
-			glViewport(0, 0, width, height);
+			window_width = width;
+			window_height = height;
+			GLFontRenderer::setScreenResolution(width, height);
+			Viewport(0, 0, width, height);
+			Redraw();
 		}
 
+		///Draw the next frame when it is due: at the target rate, or while idle at the idle rate and only if something changed.
+		///Sleeps in short slices, so that GLUT keeps handling input in between.
 		void idleCallback()
 		{
+			PacingClock::time_point now = PacingClock::now();
+			bool idle_frame = idle && !redraw_requested;
+			std::chrono::duration<double> frame_time(1.0 / (idle_frame ? idle_fps : target_fps));
+			PacingClock::time_point deadline = last_frame + std::chrono::duration_cast<PacingClock::duration>(frame_time);
+
+			if (now < deadline)
+			{
+				std::this_thread::sleep_for(std::min(deadline - now, PacingClock::duration(std::chrono::milliseconds(5))));
+				return;
+			}
+
+			//keep the frames on their deadlines, unless we are a whole frame late
+			last_frame = (now - deadline < frame_time) ? deadline : now;
+
+			if (idle_frame && !(changed_func && changed_func()))
+				return;
+
+			redraw_requested = false;
 			glClearColor(background_color.x, background_color.y, background_color.z, 1.f);
 			glutPostRedisplay();
 		}
@@ -238,6 +426,9 @@ namespace VisualDebugger
 			glutInit(&argc, argv);
 
 			glutInitWindowSize(width, height);
+			window_width = width;
+			window_height = height;
+			GLFontRenderer::setScreenResolution(width, height);
 			glutInitDisplayMode(GLUT_RGB|GLUT_DOUBLE|GLUT_DEPTH);
 			glutSetWindow(glutCreateWindow(name));
 			glutReshapeFunc(reshapeCallback);
@@ -265,20 +456,55 @@ namespace VisualDebugger
 			glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuseColor);
 			glLightfv(GL_LIGHT0, GL_POSITION, position);
 			glEnable(GL_LIGHT0);
+
+			// Shadow maps need depth textures with comparison
+			const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+			shadows_supported = extensions && strstr(extensions, "GL_ARB_depth_texture") && strstr(extensions, "GL_ARB_shadow");
+			bgra_colors_supported = extensions && (strstr(extensions, "GL_ARB_vertex_array_bgra") || strstr(extensions, "GL_EXT_vertex_array_bgra"));
+		}
+
+		void Release()
+		{
+			MeshCache::Release();
+			cloth_buffers.clear();
+			task_pool.Stop();
+			if (shadow_texture)
+				glDeleteTextures(1, &shadow_texture);
+			shadow_texture = 0;
+			shadow_map_size = 0;
+		}
+
+		void Viewport(int x, int y, int width, int height)
+		{
+			//text belongs to the previous viewport
+			FlushText();
+
+			viewport_x = x;
+			viewport_y = y;
+			viewport_width = width > 0 ? width : 1;
+			viewport_height = height > 0 ? height : 1;
+			glViewport(x, y, viewport_width, viewport_height);
+			//clear only the viewport
+			glScissor(x, y, viewport_width, viewport_height);
+			glEnable(GL_SCISSOR_TEST);
 		}
 
 		void Start(const PxVec3& cameraEye, const PxVec3& cameraDir)
 		{
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			camera_eye = cameraEye;
+			CollectReleased();
 
 			// Setup camera
 			glMatrixMode(GL_PROJECTION);
 			glLoadIdentity();
-			gluPerspective(60.f, (float)glutGet(GLUT_WINDOW_WIDTH)/(float)glutGet(GLUT_WINDOW_HEIGHT), 1.f, 10000.f);
+			gluPerspective(field_of_view, (float)viewport_width/(float)viewport_height, 1.f, 10000.f);
 
 			glMatrixMode(GL_MODELVIEW);
 			glLoadIdentity();
 			gluLookAt(cameraEye.x, cameraEye.y, cameraEye.z, cameraEye.x + cameraDir.x, cameraEye.y + cameraDir.y, cameraEye.z + cameraDir.z, 0.f, 1.f, 0.f);
+
+			UpdateFrustum();
 		}
 
 		void BackgroundColor(const PxVec3& color)
@@ -286,83 +512,541 @@ namespace VisualDebugger
 			background_color = color;
 		}
 
-		void Render(PxActor** actors, const PxU32 numActors)
+		///A single shape queued for drawing
+		struct DrawItem
 		{
-			PxVec3 shadow_color = default_color*0.9;
-			for(PxU32 i=0;i<numActors;i++)
+			GLuint mesh;
+			PxVec3 color;
+			PxMat44 pose;
+			bool lit;
+			bool visible;
+			bool shadow_visible;
+		};
+
+		///Sort key of a draw item and its index in draw_items
+		struct DrawKey
+		{
+			PxU64 key;
+			PxU32 item;
+		};
+
+		//per-instance transforms and colours, reused between frames
+		std::vector<DrawItem> draw_items;
+		//draw order, sorted by state
+		std::vector<DrawKey> draw_keys;
+		std::vector<DrawKey> sort_buffer;
+
+		//lighting is the most expensive state change, then the mesh, then the colour
+		const PxU64 key_lit_bit = 1ull << 63;
+		const int key_mesh_shift = 24;
+
+		PxU64 SortKey(const DrawItem& item)
+		{
+			PxU64 key = item.lit ? key_lit_bit : 0;
+			key |= ((PxU64)item.mesh & 0x7fffffffff) << key_mesh_shift;
+			//8 bits per channel, what the frame buffer can show anyway
+			key |= (PxU64)(PxClamp(item.color.x, 0.f, 1.f)*255.f + .5f) << 16;
+			key |= (PxU64)(PxClamp(item.color.y, 0.f, 1.f)*255.f + .5f) << 8;
+			key |= (PxU64)(PxClamp(item.color.z, 0.f, 1.f)*255.f + .5f);
+			return key;
+		}
+
+		///Sort the keys with a least significant digit radix sort, 8 bits per pass.
+		///Passes over bytes that are the same in all keys (e.g. the upper mesh bits) are skipped.
+		void RadixSort(std::vector<DrawKey>& keys, std::vector<DrawKey>& buffer)
+		{
+			PxU32 count = (PxU32)keys.size();
+			if (count < 2)
+				return;
+			buffer.resize(count);
+
+			PxU32 histograms[8][256];
+			memset(histograms, 0, sizeof(histograms));
+			for (PxU32 i = 0; i < count; i++)
 			{
-				if (actors[i]->isCloth())
+				for (int pass = 0; pass < 8; pass++)
+					histograms[pass][(keys[i].key >> (pass * 8)) & 0xff]++;
+			}
+
+			for (int pass = 0; pass < 8; pass++)
+			{
+				PxU32* histogram = histograms[pass];
+				if (histogram[(keys[0].key >> (pass * 8)) & 0xff] == count)
+					continue;
+
+				PxU32 offset = 0;
+				for (int digit = 0; digit < 256; digit++)
 				{
-					RenderCloth((PxCloth*)actors[i]);
+					PxU32 digit_count = histogram[digit];
+					histogram[digit] = offset;
+					offset += digit_count;
 				}
-				else if (actors[i]->isRigidActor())
+				for (PxU32 i = 0; i < count; i++)
+					buffer[histogram[(keys[i].key >> (pass * 8)) & 0xff]++] = keys[i];
+				keys.swap(buffer);
+			}
+		}
+
+		///Sort the queued shapes by state
+		void SortItems()
+		{
+			draw_keys.resize(draw_items.size());
+			for (PxU32 i = 0; i < draw_items.size(); i++)
+			{
+				draw_keys[i].key = SortKey(draw_items[i]);
+				draw_keys[i].item = i;
+			}
+			RadixSort(draw_keys, sort_buffer);
+		}
+
+		///Draw the queued shapes in sorted order, lighting and colour change only between groups with different keys.
+		///Shadow casters are drawn without colour and include shapes that are only visible through their shadow,
+		///unlit shapes (planes) do not cast shadows.
+		void RenderItems(bool shadow_casters)
+		{
+			bool lighting = true;
+			for (PxU32 first = 0; first < draw_keys.size();)
+			{
+				PxU64 key = draw_keys[first].key;
+				PxU32 last = first + 1;
+				while ((last < draw_keys.size()) && (draw_keys[last].key == key))
+					last++;
+
+				bool lit = (key & key_lit_bit) != 0;
+				if (shadow_casters && !lit)
 				{
-					PxRigidActor* rigid_actor = (PxRigidActor*)actors[i];
-					std::vector<PxShape*> shapes(rigid_actor->getNbShapes());
-					rigid_actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
+					first = last;
+					continue;
+				}
 
-					for(PxU32 j = 0; j < shapes.size(); j++)
+				if (!shadow_casters)
+				{
+					if (lit != lighting)
 					{
-						const PxShape* shape = shapes[j];
-						PxTransform pose = PxShapeExt::getGlobalPose(*shape, *shape->getActor());
-						PxGeometryHolder h = shape->getGeometry();
-						//move the plane slightly down to avoid visual artefacts
-						if (h.getType() == PxGeometryType::ePLANE)
-						{
-							pose.q *= PxQuat(PxHalfPi, PxVec3(0.f, 0.f, 1.f));
-							pose.p += PxVec3(0,-0.01,0);
-						}
-
-						PxMat44 shapePose(pose);
-						// render object
-						glPushMatrix();						
-						glMultMatrixf((float*)&shapePose);
-
-						PxVec3 shape_color = default_color;
-
-						if (shape->userData)
-						{
-							shape_color = *(((UserData*)shape->userData)->color);
-							if (h.getType() == PxGeometryType::ePLANE)
-							{
-								shadow_color = shape_color*0.9;
-							}
-						}
-
-						if (h.getType() == PxGeometryType::ePLANE)
+						if (lit)
+							glEnable(GL_LIGHTING);
+						else
 							glDisable(GL_LIGHTING);
+						lighting = lit;
+					}
+					const PxVec3& color = draw_items[draw_keys[first].item].color;
+					glColor4f(color.x, color.y, color.z, 1.f);
+				}
 
-						glColor4f(shape_color.x, shape_color.y, shape_color.z, 1.f);
+				for (PxU32 i = first; i < last; i++)
+				{
+					const DrawItem& item = draw_items[draw_keys[i].item];
+					if (!shadow_casters && !item.visible)
+						continue;
+					glPushMatrix();
+					glMultMatrixf((float*)&item.pose);
+					glCallList(item.mesh);
+					draw_calls++;
+					glPopMatrix();
+				}
 
-						RenderGeometry(h);
+				first = last;
+			}
 
-						if (h.getType() == PxGeometryType::ePLANE)
-							glEnable(GL_LIGHTING);
+			if (!shadow_casters && !lighting)
+				glEnable(GL_LIGHTING);
+		}
 
-						glPopMatrix();
+		///Render the depth of the queued shapes from the light into the shadow texture.
+		///The depth is rendered into the current viewport and cleared afterwards.
+		void RenderShadowMap(const PxBounds3& region)
+		{
+			//the largest square that fits into the viewport
+			int size = 1;
+			while ((size*2 <= viewport_width) && (size*2 <= viewport_height) && (size*2 <= max_shadow_map_size))
+				size *= 2;
 
-						if(show_shadows && (h.getType() != PxGeometryType::ePLANE))
-						{
-							const PxVec3 shadowDir(-0.7071067f, -0.7071067f, -0.7071067f);
-							const PxReal shadowMat[]={ 1,0,0,0, -shadowDir.x/shadowDir.y,0,-shadowDir.z/shadowDir.y,0, 0,0,1,0, 0,0,0,1 };
-							glPushMatrix();						
-							glMultMatrixf(shadowMat);
-							glMultMatrixf((float*)&shapePose);
-							glDisable(GL_LIGHTING);
-							glColor4f(shadow_color.x, shadow_color.y, shadow_color.z, 1.f);
-							RenderGeometry(h);
-							glEnable(GL_LIGHTING);
-							glPopMatrix();
-						}
+			if (size != shadow_map_size)
+			{
+				if (!shadow_texture)
+					glGenTextures(1, &shadow_texture);
+				glBindTexture(GL_TEXTURE_2D, shadow_texture);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				//1 where the fragment is behind the stored depth (in shadow), 0 where it is lit.
+				//ARB_shadow only has LEQUAL and GEQUAL, the polygon offset keeps lit surfaces in front of their own depth.
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE_ARB, GL_COMPARE_R_TO_TEXTURE_ARB);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC_ARB, GL_GEQUAL);
+				glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_TEXTURE_MODE_ARB, GL_LUMINANCE);
+				glBindTexture(GL_TEXTURE_2D, 0);
+				shadow_map_size = size;
+			}
+
+			//orthographic projection along the light direction that covers the region
+			PxVec3 center = region.getCenter();
+			PxReal radius = PxMax(region.getExtents().magnitude(), 1.f);
+
+			glMatrixMode(GL_PROJECTION);
+			glPushMatrix();
+			glLoadIdentity();
+			glOrtho(-radius, radius, -radius, radius, 0.f, 4.f*radius);
+			glGetFloatv(GL_PROJECTION_MATRIX, (float*)&light_projection);
+
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glLoadIdentity();
+			PxVec3 light_eye = center - shadowDir*2.f*radius;
+			gluLookAt(light_eye.x, light_eye.y, light_eye.z, center.x, center.y, center.z, 0.f, 1.f, 0.f);
+			glGetFloatv(GL_MODELVIEW_MATRIX, (float*)&light_view);
+
+			//the depth buffer is borrowed for the light pass, nothing drawn before may end up in the map
+			glViewport(viewport_x, viewport_y, size, size);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glDisable(GL_LIGHTING);
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(2.f, 4.f);
+
+			RenderItems(true);
+
+			glBindTexture(GL_TEXTURE_2D, shadow_texture);
+			glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport_x, viewport_y, size, size);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			glEnable(GL_LIGHTING);
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glViewport(viewport_x, viewport_y, viewport_width, viewport_height);
+
+			glPopMatrix();
+			glMatrixMode(GL_PROJECTION);
+			glPopMatrix();
+			glMatrixMode(GL_MODELVIEW);
+		}
+
+		///Project the shadow texture onto everything drawn until DisableShadows.
+		///Must be called with the camera modelview matrix.
+		void EnableShadows(const PxVec3& shadow_color)
+		{
+			//generate world space coordinates (eye planes are multiplied by the inverse camera matrix)
+			const PxReal planes[4][4] = { { 1.f, 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f, 0.f }, { 0.f, 0.f, 1.f, 0.f }, { 0.f, 0.f, 0.f, 1.f } };
+			const GLenum coords[4] = { GL_S, GL_T, GL_R, GL_Q };
+			const GLenum gen_modes[4] = { GL_TEXTURE_GEN_S, GL_TEXTURE_GEN_T, GL_TEXTURE_GEN_R, GL_TEXTURE_GEN_Q };
+			for (int i = 0; i < 4; i++)
+			{
+				glTexGeni(coords[i], GL_TEXTURE_GEN_MODE, GL_EYE_LINEAR);
+				glTexGenfv(coords[i], GL_EYE_PLANE, planes[i]);
+				glEnable(gen_modes[i]);
+			}
+
+			//world space to shadow texture space
+			glMatrixMode(GL_TEXTURE);
+			glLoadIdentity();
+			glTranslatef(.5f, .5f, .5f);
+			glScalef(.5f, .5f, .5f);
+			glMultMatrixf((float*)&light_projection);
+			glMultMatrixf((float*)&light_view);
+			glMatrixMode(GL_MODELVIEW);
+
+			//shadowed fragments take the shadow colour, lit ones keep their own
+			const PxReal env_color[] = { shadow_color.x, shadow_color.y, shadow_color.z, 1.f };
+			glBindTexture(GL_TEXTURE_2D, shadow_texture);
+			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_BLEND);
+			glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, env_color);
+			glEnable(GL_TEXTURE_2D);
+		}
+
+		void DisableShadows()
+		{
+			glDisable(GL_TEXTURE_2D);
+			glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glDisable(GL_TEXTURE_GEN_S);
+			glDisable(GL_TEXTURE_GEN_T);
+			glDisable(GL_TEXTURE_GEN_R);
+			glDisable(GL_TEXTURE_GEN_Q);
+			glMatrixMode(GL_TEXTURE);
+			glLoadIdentity();
+			glMatrixMode(GL_MODELVIEW);
+		}
+
+		///Queue the chunks of a heightfield that are on screen (or cast a visible shadow),
+		///each at a level of detail that keeps its cells a few pixels wide
+		void AddHeightField(const PxHeightFieldGeometry& geometry, const MeshCache::MeshSourcePtr& source, const PxTransform& pose,
+			const PxVec3& color, bool shadows, PxBounds3& shadow_region)
+		{
+			if (!source)
+				return;
+			MeshCache::HeightFieldChunks& chunks = MeshCache::GetHeightField(geometry, source);
+			PxReal cell_size = PxMax(PxAbs(geometry.rowScale), PxAbs(geometry.columnScale));
+			PxReal pixels_per_unit = viewport_height * .5f / PxTan(PxPi * field_of_view / 360.f);
+
+			for (PxU32 i = 0; i < chunks.bounds.size(); i++)
+			{
+				PxBounds3 bounds = PxBounds3::transformFast(pose, chunks.bounds[i]);
+				PxBounds3 shadow_bounds = ShadowBounds(bounds);
+
+				DrawItem item;
+				item.lit = true;
+				item.visible = InFrustum(bounds);
+				item.shadow_visible = shadows && InFrustum(shadow_bounds);
+				if (!item.visible && !item.shadow_visible)
+					continue;
+				if (item.shadow_visible)
+				{
+					shadow_region.include(bounds);
+					shadow_region.include(shadow_bounds);
+				}
+
+				//size of a cell at the nearest point of the chunk
+				PxReal distance = PxMax((bounds.getCenter() - camera_eye).magnitude() - bounds.getExtents().magnitude(), 1.f);
+				PxReal cell_pixels = cell_size / distance * pixels_per_unit;
+				int lod = 0;
+				while ((lod + 1 < MeshCache::heightfield_lods) && (cell_pixels * (2 << lod) <= 8.f))
+					lod++;
+
+				item.mesh = MeshCache::GetHeightFieldChunk(geometry, source, i, lod);
+				item.pose = PxMat44(pose);
+				item.color = color;
+				draw_items.push_back(item);
+			}
+		}
+
+		///Copy the particles and quads of a cloth (the vectors keep their memory between steps)
+		void SnapshotCloth(const PxCloth* cloth, ClothSnapshot& snapshot)
+		{
+			PxClothMeshDesc* mesh_desc = ((UserData*)cloth->userData)->cloth_mesh_desc;
+			snapshot.cloth = cloth;
+			snapshot.pose = cloth->getGlobalPose();
+			snapshot.color = *((UserData*)cloth->userData)->color;
+			snapshot.bounds = cloth->getWorldBounds();
+
+			const PxU32* quads = (const PxU32*)mesh_desc->quads.data;
+			snapshot.quads.assign(quads, quads + mesh_desc->quads.count*4);
+
+			snapshot.particles.resize(cloth->getNbParticles());
+			PxClothParticleData* particle_data = cloth->lockParticleData();
+			if (!particle_data)
+			{
+				snapshot.particles.clear();
+				return;
+			}
+			for (PxU32 i = 0; i < snapshot.particles.size(); i++)
+				snapshot.particles[i] = particle_data->particles[i].pos;
+			particle_data->unlock();
+		}
+
+		void Snapshot(PxActor** actors, const PxU32 numActors, std::vector<ShapeSnapshot>& snapshot, std::vector<ClothSnapshot>& cloths,
+			MeshCache::SourceCache& sources)
+		{
+			snapshot.clear();
+			std::vector<PxShape*> shapes;
+			PxU32 num_cloths = 0;
+
+			for(PxU32 i=0;i<numActors;i++)
+			{
+				if (actors[i]->isCloth())
+				{
+					//the cloth snapshots are reused in place
+					if (num_cloths == cloths.size())
+						cloths.resize(num_cloths + 1);
+					SnapshotCloth((const PxCloth*)actors[i], cloths[num_cloths++]);
+					continue;
+				}
+
+				if (!actors[i]->isRigidActor())
+					continue;
+
+				PxRigidActor* rigid_actor = (PxRigidActor*)actors[i];
+				shapes.resize(rigid_actor->getNbShapes());
+				if (!shapes.size())
+					continue;
+				rigid_actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
+
+				for(PxU32 j = 0; j < shapes.size(); j++)
+				{
+					const PxShape* shape = shapes[j];
+					ShapeSnapshot shape_snapshot;
+					shape_snapshot.geometry = shape->getGeometry();
+					shape_snapshot.source = sources.Get(shape_snapshot.geometry);
+					shape_snapshot.pose = PxShapeExt::getGlobalPose(*shape, *rigid_actor);
+					shape_snapshot.previous_pose = shape_snapshot.pose;
+					shape_snapshot.actor = rigid_actor;
+					shape_snapshot.shape = shape;
+					shape_snapshot.color = shape->userData ? *(((UserData*)shape->userData)->color) : default_color;
+					//planes are infinite
+					if (shape_snapshot.geometry.getType() == PxGeometryType::ePLANE)
+						shape_snapshot.bounds = PxBounds3::empty();
+					else
+						shape_snapshot.bounds = PxShapeExt::getWorldBounds(*shape, *rigid_actor);
+					snapshot.push_back(shape_snapshot);
+				}
+			}
+			cloths.resize(num_cloths);
+		}
+
+		///Spherical interpolation, t outside 0..1 continues the rotation
+		PxQuat Slerp(const PxQuat& from, const PxQuat& to, PxReal t)
+		{
+			//take the shorter way around
+			PxReal cos_angle = from.dot(to);
+			PxQuat target = (cos_angle < 0.f) ? -to : to;
+			cos_angle = PxAbs(cos_angle);
+			//nearly the same rotation, a normalised lerp avoids dividing by a tiny sine
+			if (cos_angle > 0.9995f)
+				return (from*(1.f - t) + target*t).getNormalized();
+			PxReal angle = PxAcos(cos_angle);
+			PxReal sin_angle = PxSin(angle);
+			return (from*(PxSin((1.f - t)*angle) / sin_angle) + target*(PxSin(t*angle) / sin_angle)).getNormalized();
+		}
+
+		PxTransform Interpolate(const PxTransform& from, const PxTransform& to, PxReal t)
+		{
+			if (t == 1.f)
+				return to;
+			return PxTransform(from.p + (to.p - from.p)*t, Slerp(from.q, to.q, t));
+		}
+
+		void RenderShapes(const ShapeSnapshot* shapes, const PxU32 num_shapes, const ClothSnapshot* cloths, const PxU32 num_cloths, PxReal alpha)
+		{
+			PxVec3 shadow_color = default_color*0.9;
+			draw_items.clear();
+			bool shadows = show_shadows && shadows_supported;
+			//part of the world that casts or receives visible shadows
+			PxBounds3 shadow_region = PxBounds3::empty();
+
+			for(PxU32 i = 0; i < num_shapes; i++)
+			{
+				PxTransform pose = Interpolate(shapes[i].previous_pose, shapes[i].pose, alpha);
+				//the bounds follow the position, the change in rotation within a step is small
+				PxVec3 offset = pose.p - shapes[i].pose.p;
+				const PxGeometryHolder& h = shapes[i].geometry;
+				//move the plane slightly down to avoid visual artefacts
+				if (h.getType() == PxGeometryType::ePLANE)
+				{
+					pose.q *= PxQuat(PxHalfPi, PxVec3(0.f, 0.f, 1.f));
+					pose.p += PxVec3(0,-0.01,0);
+				}
+
+				if (h.getType() == PxGeometryType::eHEIGHTFIELD)
+				{
+					AddHeightField(h.heightField(), shapes[i].source, pose, shapes[i].color, shadows, shadow_region);
+					continue;
+				}
+
+				DrawItem item;
+				item.lit = (h.getType() != PxGeometryType::ePLANE);
+				item.visible = item.shadow_visible = true;
+				//planes are infinite, everything else is culled against the view frustum
+				if (item.lit)
+				{
+					PxBounds3 bounds(shapes[i].bounds.minimum + offset, shapes[i].bounds.maximum + offset);
+					item.visible = InFrustum(bounds);
+					PxBounds3 shadow_bounds = ShadowBounds(bounds);
+					item.shadow_visible = shadows && InFrustum(shadow_bounds);
+					if (!item.visible && !item.shadow_visible)
+						continue;
+					if (item.shadow_visible)
+					{
+						shadow_region.include(bounds);
+						shadow_region.include(shadow_bounds);
 					}
 				}
 
+				int detail = render_detail;
+				if (h.getType() == PxGeometryType::eSPHERE)
+					detail = DetailLevel(pose.p, h.sphere().radius);
+				else if (h.getType() == PxGeometryType::eCAPSULE)
+					detail = DetailLevel(pose.p, h.capsule().radius + h.capsule().halfHeight);
+				item.mesh = MeshCache::Get(h, detail, shapes[i].source);
+				if (!item.mesh)
+					continue;
+				item.pose = PxMat44(pose);
+				item.color = shapes[i].color;
+				if (!item.lit)
+					shadow_color = item.color*0.9;
+				draw_items.push_back(item);
+			}
+
+			//the draw order depends on state only, not on the order actors were added
+			SortItems();
+
+			//a single depth pass from the light, the main pass below projects it onto all shapes
+			shadows = shadows && !shadow_region.isEmpty();
+			if (shadows)
+			{
+				RenderShadowMap(shadow_region);
+				EnableShadows(shadow_color);
 			}
+
+			//planes (unlit) first, then everything else
+			RenderItems(false);
+
+			for (PxU32 i = 0; i < num_cloths; i++)
+			{
+				if (InFrustum(cloths[i].bounds))
+					RenderCloth(cloths[i]);
+			}
+
+			if (shadows)
+				DisableShadows();
+		}
+
+		void Render(const ShapeSnapshot* shapes, const PxU32 num_shapes, const ClothSnapshot* cloths, const PxU32 num_cloths, PxReal alpha)
+		{
+			RenderShapes(shapes, num_shapes, cloths, num_cloths, alpha);
+		}
+
+		void FrameRate(PxReal _target_fps, PxReal _idle_fps)
+		{
+			target_fps = PxMax(_target_fps, 1.f);
+			idle_fps = PxMax(_idle_fps, 1.f);
+		}
+
+		void Idle(bool value)
+		{
+			idle = value;
+		}
+
+		void Redraw()
+		{
+			redraw_requested = true;
+		}
+
+		void ChangedFunc(bool (*callback)())
+		{
+			changed_func = callback;
+		}
+
+		PxReal FieldOfView()
+		{
+			return field_of_view;
+		}
+
+		int WindowWidth()
+		{
+			return window_width;
+		}
+
+		int WindowHeight()
+		{
+			return window_height;
+		}
+
+		void DrawCalls(PxU32 value)
+		{
+			draw_calls = value;
+		}
+
+		PxU32 DrawCalls()
+		{
+			return draw_calls;
 		}
 
 		void Finish()
 		{
+			FlushText();
 			glutSwapBuffers();
+			finish_count++;
 		}
 
 		void SetRenderDetail(int value)
@@ -377,13 +1061,33 @@ namespace VisualDebugger
 
 		bool ShowShadows() { return show_shadows; }
 
-		void RenderBuffer(float* pVertList, float* pColorList, int type, int num)
+		///Draw PhysX debug primitives in place. Points, lines and triangles are all
+		///arrays of { PxVec3 pos; PxU32 color; } vertices, 16 bytes apart.
+		void RenderBuffer(const void* vertices, int type, PxU32 num)
 		{
+			const PxU32 stride = sizeof(PxVec3) + sizeof(PxU32);
+			const char* data = (const char*)vertices;
+
 			glEnableClientState(GL_VERTEX_ARRAY);
-			glVertexPointer(3,GL_FLOAT, 0, pVertList);
+			glVertexPointer(3, GL_FLOAT, stride, data);
 			glEnableClientState(GL_COLOR_ARRAY);
-			glColorPointer(4, GL_FLOAT, 0, pColorList);
+			if (bgra_colors_supported)
+			{
+				glColorPointer(GL_BGRA, GL_UNSIGNED_BYTE, stride, data + sizeof(PxVec3));
+			}
+			else
+			{
+				//ARGB to ABGR
+				debug_colors.resize(num);
+				for (PxU32 i = 0; i < num; i++)
+				{
+					PxU32 color = *(const PxU32*)(data + i*stride + sizeof(PxVec3));
+					debug_colors[i] = 0xff000000 | (color & 0x0000ff00) | ((color >> 16) & 0xff) | ((color & 0xff) << 16);
+				}
+				glColorPointer(4, GL_UNSIGNED_BYTE, 0, &debug_colors.front());
+			}
 			glDrawArrays(type, 0, num);
+			draw_calls++;
 			glDisableClientState(GL_COLOR_ARRAY);
 			glDisableClientState(GL_VERTEX_ARRAY);
 		}
@@ -392,121 +1096,120 @@ namespace VisualDebugger
 		///TODO: support text data
 		void Render(const PxRenderBuffer& data, PxReal line_width)
 		{
-			glLineWidth(line_width);
+			Render(data.getPoints(), data.getNbPoints(), data.getLines(), data.getNbLines(), data.getTriangles(), data.getNbTriangles(), line_width);
 
-			//render points
+			//TODO: render texts ?
+		}
 
-			unsigned int NbPoints = data.getNbPoints();
-			if(NbPoints)
-			{
-				std::vector<float> pVertList(NbPoints*3);
-				std::vector<float> pColorList(NbPoints*4);
-				int vertIndex = 0;
-				int colorIndex = 0;
-				const physx::PxDebugPoint* Points = data.getPoints();
-				while(NbPoints--)
-				{
-					pVertList[vertIndex++] = Points->pos.x;
-					pVertList[vertIndex++] = Points->pos.y;
-					pVertList[vertIndex++] = Points->pos.z;
-					pColorList[colorIndex++] = (float)((Points->color>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Points->color>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Points->color&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-					Points++;
-				}
+		void Render(const PxDebugPoint* points, PxU32 num_points, const PxDebugLine* lines, PxU32 num_lines,
+			const PxDebugTriangle* triangles, PxU32 num_triangles, PxReal line_width)
+		{
+			glLineWidth(line_width);
 
-				RenderBuffer(&pVertList.front(), &pColorList.front(), GL_POINTS, data.getNbPoints());
-			}
+			if (num_points)
+				RenderBuffer(points, GL_POINTS, num_points);
 
-			//render lines
+			if (num_lines)
+				RenderBuffer(lines, GL_LINES, num_lines*2);
 
-			unsigned int NbLines = data.getNbLines();
-			if(NbLines)
-			{
-				std::vector<float> pVertList(NbLines*3*2);
-				std::vector<float> pColorList(NbLines*4*2);
-				int vertIndex = 0;
-				int colorIndex = 0;
-				const PxDebugLine* Lines = data.getLines();
-				while(NbLines--)
-				{
-					pVertList[vertIndex++] = Lines->pos0.x;
-					pVertList[vertIndex++] = Lines->pos0.y;
-					pVertList[vertIndex++] = Lines->pos0.z;
-					pColorList[colorIndex++] = (float)((Lines->color0>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Lines->color0>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Lines->color0&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-
-					pVertList[vertIndex++] = Lines->pos1.x;
-					pVertList[vertIndex++] = Lines->pos1.y;
-					pVertList[vertIndex++] = Lines->pos1.z;
-					pColorList[colorIndex++] = (float)((Lines->color1>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Lines->color1>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Lines->color1&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-
-					Lines++;
-				}
+			if (num_triangles)
+				RenderBuffer(triangles, GL_TRIANGLES, num_triangles*3);
+		}
 
-				RenderBuffer(&pVertList.front(), &pColorList.front(), GL_LINES, data.getNbLines()*2);
-			}
+		void Render(const PxVec3* points, PxU32 num_points, const PxVec3& color, PxReal line_width)
+		{
+			if (num_points < 2)
+				return;
 
-			//render triangles
+			glLineWidth(line_width);
+			glDisable(GL_LIGHTING);
+			glColor4f(color.x, color.y, color.z, 1.f);
+			glEnableClientState(GL_VERTEX_ARRAY);
+			glVertexPointer(3, GL_FLOAT, sizeof(PxVec3), points);
+			glDrawArrays(GL_LINE_STRIP, 0, num_points);
+			draw_calls++;
+			glDisableClientState(GL_VERTEX_ARRAY);
+			glEnable(GL_LIGHTING);
+		}
 
-			unsigned int NbTris = data.getNbTriangles();
-			if(NbTris)
-			{
-				std::vector<float> pVertList(NbTris*3*3);
-				std::vector<float> pColorList(NbTris*4*3);
-				int vertIndex = 0;
-				int colorIndex = 0;
-				const PxDebugTriangle* Triangles = data.getTriangles();
-				while(NbTris--)
-				{
-					pVertList[vertIndex++] = Triangles->pos0.x;
-					pVertList[vertIndex++] = Triangles->pos0.y;
-					pVertList[vertIndex++] = Triangles->pos0.z;
-
-					pVertList[vertIndex++] = Triangles->pos1.x;
-					pVertList[vertIndex++] = Triangles->pos1.y;
-					pVertList[vertIndex++] = Triangles->pos1.z;
-
-					pVertList[vertIndex++] = Triangles->pos2.x;
-					pVertList[vertIndex++] = Triangles->pos2.y;
-					pVertList[vertIndex++] = Triangles->pos2.z;
-
-					pColorList[colorIndex++] = (float)((Triangles->color0>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Triangles->color0>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Triangles->color0&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-
-					pColorList[colorIndex++] = (float)((Triangles->color1>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Triangles->color1>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Triangles->color1&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-
-					pColorList[colorIndex++] = (float)((Triangles->color2>>16)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)((Triangles->color2>>8)&0xff)/255.f;
-					pColorList[colorIndex++] = (float)(Triangles->color2&0xff)/255.f;
-					pColorList[colorIndex++] = 1.f;
-
-					Triangles++;
-				}
+		void RenderText(const std::string& text, const physx::PxVec2& location, 
+			const PxVec3& color, PxReal size)
+		{
+			GLFontRenderer::setColor(color.x, color.y, color.z, 1.f);
+			GLFontRenderer::add(location.x, location.y, size, text.c_str());
+		}
 
-				RenderBuffer(&pVertList.front(), &pColorList.front(), GL_TRIANGLES, data.getNbTriangles()*3);
-			}
+		void LayoutText(const std::string& text, const physx::PxVec2& location,
+			const PxVec3& color, PxReal size, TextLayout& layout)
+		{
+			GLFontRenderer::setColor(color.x, color.y, color.z, 1.f);
+			GLFontRenderer::layout(location.x, location.y, size, text.c_str(), layout);
+		}
 
-			//TODO: render texts ?
+		void RenderText(const TextLayout& layout)
+		{
+			GLFontRenderer::add(layout);
 		}
 
-		void RenderText(const std::string& text, const physx::PxVec2& location, 
+		void RenderText(const char* text, const physx::PxVec2& location,
 			const PxVec3& color, PxReal size)
 		{
 			GLFontRenderer::setColor(color.x, color.y, color.z, 1.f);
-			GLFontRenderer::setScreenResolution(glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
-			GLFontRenderer::print(location.x, location.y, size, text.c_str());
+			GLFontRenderer::add(location.x, location.y, size, text);
+		}
+
+		void RenderGraph(const PxReal* values, PxU32 num_values, PxU32 first, PxReal max_value,
+			const PxVec2& location, const PxVec2& size, const PxVec3& color)
+		{
+			if ((num_values < 2) || (max_value <= 0.f))
+				return;
+
+			glMatrixMode(GL_PROJECTION);
+			glPushMatrix();
+			glLoadIdentity();
+			glOrtho(0, 1, 0, 1, -1, 1);
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glLoadIdentity();
+			glDisable(GL_LIGHTING);
+			glDisable(GL_DEPTH_TEST);
+
+			//translucent background
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glColor4f(0.f, 0.f, 0.f, .35f);
+			glBegin(GL_QUADS);
+			glVertex2f(location.x, location.y);
+			glVertex2f(location.x + size.x, location.y);
+			glVertex2f(location.x + size.x, location.y + size.y);
+			glVertex2f(location.x, location.y + size.y);
+			glEnd();
+			glDisable(GL_BLEND);
+
+			//oldest value on the left
+			glLineWidth(1.f);
+			glColor4f(color.x, color.y, color.z, 1.f);
+			glBegin(GL_LINE_STRIP);
+			for (PxU32 i = 0; i < num_values; i++)
+			{
+				PxReal value = PxMin(values[(first + i) % num_values] / max_value, 1.f);
+				glVertex2f(location.x + size.x * i / (num_values - 1), location.y + size.y * value);
+			}
+			glEnd();
+			draw_calls += 2;
+
+			glEnable(GL_DEPTH_TEST);
+			glEnable(GL_LIGHTING);
+			glPopMatrix();
+			glMatrixMode(GL_PROJECTION);
+			glPopMatrix();
+			glMatrixMode(GL_MODELVIEW);
+		}
+
+		void FlushText()
+		{
+			if (GLFontRenderer::flush())
+				draw_calls++;
 		}
 	}
 }
@@ -2,8 +2,10 @@
 
 #include "PxPhysicsAPI.h"
 #include "GLFontRenderer.h"
+#include "MeshCache.h"
 #include <GL/glut.h>
 #include <string>
+#include <vector>
 
 namespace VisualDebugger
 {
@@ -11,32 +13,126 @@ namespace VisualDebugger
 	{
 		using namespace physx;
 
+		///A shape captured for drawing, e.g. on another thread than the simulation
+		struct ShapeSnapshot
+		{
+			//type and size only, the mesh and heightfield pointers in it are never dereferenced by the renderer
+			PxGeometryHolder geometry;
+			//mesh or heightfield data the renderer reads instead, empty for other geometry
+			MeshCache::MeshSourcePtr source;
+			PxTransform pose;
+			//pose after the step before, rendering blends from it to pose
+			PxTransform previous_pose;
+			PxVec3 color;
+			//world bounds, empty for planes
+			PxBounds3 bounds;
+			//identity of the shape between snapshots, never dereferenced by the renderer
+			const PxRigidActor* actor;
+			const PxShape* shape;
+		};
+
+		///Particles and quads of a cloth, captured for drawing
+		struct ClothSnapshot
+		{
+			PxTransform pose;
+			PxVec3 color;
+			PxBounds3 bounds;
+			//particle positions (local space)
+			std::vector<PxVec3> particles;
+			//4 particle indices per quad
+			std::vector<PxU32> quads;
+			//identity of the cloth between snapshots, never dereferenced by the renderer
+			const PxCloth* cloth;
+		};
+
 		///Init rendering window
 		void InitWindow(const char *name, int width, int height);
 
 		///Init renderer
 		void Init();
 
-		///Start rendering a single frame
+		///Release meshes cached by the renderer
+		void Release();
+
+		///Set the part of the window used by the next Start (in pixels, origin at the bottom left)
+		void Viewport(int x, int y, int width, int height);
+
+		///Frame pacing: frames are drawn at most at target_fps. While idle the window is checked
+		///for changes at idle_fps only and redrawn only if something changed.
+		void FrameRate(PxReal target_fps, PxReal idle_fps=10.f);
+
+		///Set idle (e.g. paused or every body asleep)
+		void Idle(bool value);
+
+		///Draw the next frame at the target rate, even when idle (e.g. after input)
+		void Redraw();
+
+		///Set the function that tells whether something changed while idle
+		void ChangedFunc(bool (*callback)());
+
+		///Vertical field of view of the projection in degrees
+		PxReal FieldOfView();
+
+		///Window size in pixels (updated when the window is resized)
+		int WindowWidth();
+		int WindowHeight();
+
+		///Start rendering a single frame (or viewport)
 		void Start(const PxVec3& cameraEye, const PxVec3& cameraDir);
 
-		///Render actors
-		void Render(PxActor** actors, const PxU32 numActors);
+		///Capture the shapes of rigid actors and the cloths (call while the scene is not simulating),
+		///mesh data is shared from sources
+		void Snapshot(PxActor** actors, const PxU32 numActors, std::vector<ShapeSnapshot>& shapes, std::vector<ClothSnapshot>& cloths,
+			MeshCache::SourceCache& sources);
+
+		///Render captured shapes at a point between the previous pose (alpha 0) and the pose (alpha 1),
+		///alpha above 1 extrapolates past the last step. Cloths are drawn as captured.
+		void Render(const ShapeSnapshot* shapes, const PxU32 num_shapes, const ClothSnapshot* cloths, const PxU32 num_cloths, PxReal alpha=1.f);
 
 		///Render debug information
 		void Render(const PxRenderBuffer& data, PxReal line_width=1.f);
 
-		///Render text
+		///Render debug primitives, e.g. copied out of a PxRenderBuffer
+		void Render(const PxDebugPoint* points, PxU32 num_points, const PxDebugLine* lines, PxU32 num_lines,
+			const PxDebugTriangle* triangles, PxU32 num_triangles, PxReal line_width=1.f);
+
+		///Render a polyline (e.g. a predicted trajectory)
+		void Render(const PxVec3* points, PxU32 num_points, const PxVec3& color, PxReal line_width=1.f);
+
+		///Render text. The text of a viewport is drawn in a single batch by the next Viewport, FlushText or Finish.
 		void RenderText(const std::string& text, const physx::PxVec2& location, 
 			const PxVec3& color, PxReal size);
 
+		///Glyphs of text laid out once, e.g. for text that rarely changes
+		typedef std::vector<GLFontRenderer::GlyphVertex> TextLayout;
+
+		///Lay out text for the current window size and append it to layout
+		void LayoutText(const std::string& text, const physx::PxVec2& location,
+			const PxVec3& color, PxReal size, TextLayout& layout);
+
+		///Render text laid out before
+		void RenderText(const TextLayout& layout);
+
+		///Render text without building a string (e.g. formatted into a fixed buffer)
+		void RenderText(const char* text, const physx::PxVec2& location,
+			const PxVec3& color, PxReal size);
+
+		///Render a rolling graph over the window (location and size in window units, 0..1).
+		///values is a ring buffer that starts at first, values above max_value are clamped.
+		void RenderGraph(const PxReal* values, PxU32 num_values, PxU32 first, PxReal max_value,
+			const PxVec2& location, const PxVec2& size, const PxVec3& color);
+
+		///Draw the queued text now (e.g. before reading the frame back)
+		void FlushText();
+
 		///Set background color
 		void BackgroundColor(const PxVec3& background_color);
 
 		///Finish rendering a single frame
 		void Finish();
 
-		///Set rendering detail for spheres and capsules.
+		///Set the maximum rendering detail for spheres and capsules.
+		///The detail of each shape is chosen from its projected size on the screen.
 		void SetRenderDetail(int value);
 
 		///Set show shadows
@@ -44,5 +140,11 @@ namespace VisualDebugger
 
 		///Get show shadows
 		bool ShowShadows();
+
+		///Set the draw call counter (e.g. to 0 at the start of a frame)
+		void DrawCalls(PxU32 value);
+
+		///Get the number of draw calls since the counter was set
+		PxU32 DrawCalls();
 	}
 }
\ No newline at end of file
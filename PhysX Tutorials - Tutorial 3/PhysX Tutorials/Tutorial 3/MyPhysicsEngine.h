@@ -38,6 +38,47 @@ namespace PhysicsEngine
 		}
 	};
 
+	///Rolling hills around the course, flat and just below the ground plane inside it
+	class Hills : public HeightField
+	{
+		static const PxU32 samples = 129;
+
+		//rows x columns heights for a square of samples x samples starting at corner
+		static vector<PxReal> Heights(const PxVec3& corner, PxReal spacing, const PxVec3& course_min, const PxVec3& course_max)
+		{
+			vector<PxReal> heights(samples*samples);
+			for (PxU32 r = 0; r < samples; r++)
+			{
+				for (PxU32 c = 0; c < samples; c++)
+				{
+					PxReal x = corner.x + r*spacing;
+					PxReal z = corner.z + c*spacing;
+					//distance from the course, the hills grow over the first 20 units
+					PxReal dx = PxMax(PxMax(course_min.x - x, x - course_max.x), 0.f);
+					PxReal dz = PxMax(PxMax(course_min.z - z, z - course_max.z), 0.f);
+					PxReal rise = PxMin(PxSqrt(dx*dx + dz*dz) / 20.f, 1.f);
+					heights[r*samples + c] = -.5f + rise*(6.f + 3.f*PxSin(x*.1f)*PxCos(z*.13f));
+				}
+			}
+			return heights;
+		}
+
+	public:
+		Hills(const PxVec3& course_min, const PxVec3& course_max, PxReal spacing = 2.f) :
+			HeightField(Heights(Corner(course_min, course_max, spacing), spacing, course_min, course_max), samples, samples,
+				PxTransform(Corner(course_min, course_max, spacing)), spacing, spacing)
+		{
+		}
+
+		//corner of the terrain, centred on the course
+		static PxVec3 Corner(const PxVec3& course_min, const PxVec3& course_max, PxReal spacing)
+		{
+			PxVec3 centre = (course_min + course_max)*.5f;
+			PxReal half_size = (samples - 1)*spacing*.5f;
+			return PxVec3(centre.x - half_size, 0.f, centre.z - half_size);
+		}
+	};
+
 	struct FilterGroup
 	{
 		enum Enum
@@ -53,6 +94,8 @@ namespace PhysicsEngine
 	class Trampoline
 	{
 		vector<DistanceJoint*> springs;
+		//top and bottom share a single broadphase entry
+		Aggregate* aggregate;
 		
 	public:
 
@@ -74,19 +117,25 @@ namespace PhysicsEngine
 				springs[i]->Stiffness(stiffness);
 				springs[i]->Damping(damping);
 			}
+
+			aggregate = new Aggregate(2);
+			aggregate->Add(bottom);
+			aggregate->Add(top);
 		}
 
 		void AddToScene(Scene* scene)
 		{
-			scene->Add(bottom);
-			scene->Add(top);
-
+			scene->Add(aggregate);
 		}
 
 		~Trampoline()
 		{
 			for (unsigned int i = 0; i < springs.size(); i++)
 				delete springs[i];
+			//the actors leave the aggregate before it is released
+			delete top;
+			delete bottom;
+			delete aggregate;
 		}
 	};
 
@@ -196,15 +245,27 @@ namespace PhysicsEngine
 		Border* border; 
 		MySimulationEventCallback* my_callback;
 		Trampoline* trampoline;
+		Hills* hills;
 
 
 	public:
 		//specify your custom filter shader here
 		//PxDefaultSimulationFilterShader by default
-		MyScene() : Scene() {};
+		MyScene() : Scene(), plane(0), golfBall(0), rectangles(0), golfClub(0), rotatingSpinner1(0), rotatingSpinner2(0),
+			club(0), box(0), spinner(0), spinner2(0), border(0), my_callback(0), trampoline(0), hills(0) {};
+
+		~MyScene()
+		{
+			EndDrag();
+			CustomRelease();
+		}
 		float myForce = 0.0f;
 		bool hasWon; 
 		int randNum = 0; 
+		//number of possible 'hole' positions
+		static const int numHoles = 6;
+		//use this 'hole' position instead of a random one (-1 = random)
+		int fixedHole = -1;
 	
 	
 		///A custom scene class
@@ -232,6 +293,11 @@ namespace PhysicsEngine
 			club = new Club(); 
 			plane->Color(PxVec3(210.f / 255.f, 210.f / 255.f, 210.f / 255.f));
 			Add(plane);
+
+			//terrain outside the border walls
+			hills = new Hills(PxVec3(-56.f, 0.f, -41.f), PxVec3(56.f, 0.f, 71.f));
+			hills->Color(PxVec3(120.f / 255.f, 160.f / 255.f, 90.f / 255.f));
+			Add(hills);
 			
 
 
@@ -300,19 +366,60 @@ namespace PhysicsEngine
 
 
 			//---------------------------------------------------------ADDS---------------------------------------------------------//
-			//Add actors to scene 
-			Add(golfBall); 
-			Add(border); 
-			Add(rectangles); 
-			Add(box); 
-			Add(spinner); 
-			Add(spinner2); 
-			Add(club);
+			//Add actors to scene in a single batch
+			Actor* course[] = { golfBall, border, rectangles, box, spinner, spinner2, club };
+			Add(course, sizeof(course) / sizeof(course[0]));
 			trampoline->AddToScene(this);
 			//-------------------------------------------------------------------------------------------------------------------------------//
 		}
 
 
+		//Release everything created by CustomInit
+		virtual void CustomRelease()
+		{
+			//joints before the actors they connect
+			delete golfClub;
+			delete rotatingSpinner1;
+			delete rotatingSpinner2;
+			delete trampoline;
+			delete plane;
+			delete hills;
+			delete golfBall;
+			delete rectangles;
+			delete club;
+			delete box;
+			delete spinner;
+			delete spinner2;
+			delete border;
+			if (px_scene)
+				px_scene->setSimulationEventCallback(0);
+			delete my_callback;
+
+			plane = 0; golfBall = 0; rectangles = 0; club = 0; box = 0; spinner = 0; spinner2 = 0; border = 0;
+			golfClub = rotatingSpinner1 = rotatingSpinner2 = 0;
+			my_callback = 0;
+			trampoline = 0;
+			hills = 0;
+		}
+
+		///Get the golf ball actor
+		Sphere* GolfBall()
+		{
+			return golfBall;
+		}
+
+		///Get the motorised joint of the golf club
+		RevoluteJoint* GolfClub()
+		{
+			return golfClub;
+		}
+
+		///Get the 'hole' (trigger box)
+		Box* Hole()
+		{
+			return box;
+		}
+
 		//adds force to club
 		void push()
 		{
@@ -325,7 +432,11 @@ namespace PhysicsEngine
 		void swichBoxPosition()
 		{
 			srand(time(NULL));
-			randNum = rand() % 7; //random number between 0 and 6
+			randNum = rand() % numHoles; //random number between 0 and 5
+			if (fixedHole >= 0)
+				randNum = fixedHole;
+			//the previous 'hole' leaves the scene
+			delete box;
 			switch (randNum)
 			{
 			case 0:
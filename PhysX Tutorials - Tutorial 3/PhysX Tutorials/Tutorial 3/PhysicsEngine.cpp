@@ -1,14 +1,37 @@
 #include "PhysicsEngine.h"
 #include <iostream>
+#include <atomic>
 
 namespace PhysicsEngine
 {
 	using namespace physx;
 	using namespace std;
 
+	///Default allocator that counts the allocations
+	class CountingAllocator : public PxAllocatorCallback
+	{
+		PxDefaultAllocator allocator;
+
+	public:
+		std::atomic<PxU32> count;
+
+		CountingAllocator() : count(0) {}
+
+		void* allocate(size_t size, const char* typeName, const char* filename, int line)
+		{
+			count++;
+			return allocator.allocate(size, typeName, filename, line);
+		}
+
+		void deallocate(void* ptr)
+		{
+			allocator.deallocate(ptr);
+		}
+	};
+
 	//default error and allocator callbacks
 	PxDefaultErrorCallback gDefaultErrorCallback;
-	PxDefaultAllocator gDefaultAllocatorCallback;
+	CountingAllocator gDefaultAllocatorCallback;
 
 	//PhysX objects
 	PxFoundation* foundation = 0;
@@ -70,6 +93,11 @@ namespace PhysicsEngine
 		return cooking;
 	}
 
+	PxU32 Allocations()
+	{
+		return gDefaultAllocatorCallback.count;
+	}
+
 	PxMaterial* GetMaterial(PxU32 index)
 	{
 		std::vector<PxMaterial*> materials(physics->getNbMaterials());
@@ -192,6 +220,8 @@ namespace PhysicsEngine
 	{
 		for (unsigned int i = 0; i < colors.size(); i++)
 			delete (UserData*)GetShape(i)->userData;
+		//also removes it from its scene
+		actor->release();
 	}
 
 	void DynamicActor::CreateShape(const PxGeometry& geometry, PxReal density)
@@ -220,6 +250,8 @@ namespace PhysicsEngine
 	{
 		for (unsigned int i = 0; i < colors.size(); i++)
 			delete (UserData*)GetShape(i)->userData;
+		//also removes it from its scene
+		actor->release();
 	}
 
 	void StaticActor::CreateShape(const PxGeometry& geometry, PxReal density)
@@ -232,6 +264,117 @@ namespace PhysicsEngine
 			((UserData*)GetShape(i)->userData)->color = &colors[i];
 	}
 
+	///ActorPool methods
+	ActorPool::ActorPool(Scene* _scene, const PxGeometry& geometry, PxU32 size, PxMaterial* material, PxReal density)
+		: scene(_scene)
+	{
+		actors.resize(size);
+		free_list.resize(size);
+		for (PxU32 i = 0; i < size; i++)
+		{
+			actors[i] = new PooledActor(PxTransform(PxIdentity));
+			actors[i]->CreateShape(geometry, density);
+			if (material)
+				actors[i]->Material(material);
+			actors[i]->pool_index = i;
+			//hand out the lowest indices first
+			free_list[i] = size - 1 - i;
+		}
+	}
+
+	ActorPool::~ActorPool()
+	{
+		//the actors release their PhysX objects, active ones leave the scene
+		for (unsigned int i = 0; i < actors.size(); i++)
+			delete actors[i];
+	}
+
+	PooledActor* ActorPool::Activate(const PxTransform& pose, const PxVec3& velocity)
+	{
+		if (!free_list.size())
+			return 0;
+
+		PooledActor* actor = actors[free_list.back()];
+		free_list.pop_back();
+
+		PxRigidDynamic* px_actor = (PxRigidDynamic*)actor->Get();
+		px_actor->setGlobalPose(pose);
+		px_actor->setLinearVelocity(velocity);
+		px_actor->setAngularVelocity(PxVec3(0.f,0.f,0.f));
+		scene->Get()->addActor(*px_actor);
+		actor->active = true;
+
+		return actor;
+	}
+
+	void ActorPool::Release(PooledActor* actor)
+	{
+		if (!actor->active)
+			return;
+
+		//a parked actor is not in the scene, it cannot stay selected or dragged
+		if (scene->GetSelectedActor() == (PxRigidDynamic*)actor->Get())
+			scene->Select(0);
+
+		scene->Get()->removeActor(*actor->Get());
+		actor->active = false;
+		free_list.push_back(actor->pool_index);
+	}
+
+	void ActorPool::ReleaseAll()
+	{
+		for (unsigned int i = 0; i < actors.size(); i++)
+			Release(actors[i]);
+	}
+
+	PxU32 ActorPool::Active()
+	{
+		return (PxU32)(actors.size() - free_list.size());
+	}
+
+	PxU32 ActorPool::Size()
+	{
+		return (PxU32)actors.size();
+	}
+
+	PxReal ActorPool::Occupancy()
+	{
+		if (!actors.size())
+			return 0.f;
+		return (PxReal)Active() / (PxReal)actors.size();
+	}
+
+	///Aggregate methods
+	Aggregate::Aggregate(PxU32 max_actors, bool self_collision)
+	{
+		aggregate = GetPhysics()->createAggregate(max_actors, self_collision);
+
+		if (!aggregate)
+			throw new Exception("PhysicsEngine::Aggregate, Could not create the aggregate.");
+	}
+
+	Aggregate::~Aggregate()
+	{
+		aggregate->release();
+	}
+
+	PxAggregate* Aggregate::Get()
+	{
+		return aggregate;
+	}
+
+	void Aggregate::Add(Actor* actor)
+	{
+		if (!aggregate->addActor(*actor->Get()))
+			throw new Exception("PhysicsEngine::Aggregate::Add, Could not add the actor to the aggregate.");
+	}
+
+	void Aggregate::Add(Actor** actors, PxU32 num_actors)
+	{
+		for (PxU32 i = 0; i < num_actors; i++)
+			Add(actors[i]);
+	}
+
 	///Scene methods
 	void Scene::Init()
 	{
@@ -240,8 +383,8 @@ namespace PhysicsEngine
 
 		if(!sceneDesc.cpuDispatcher)
 		{
-			PxDefaultCpuDispatcher* mCpuDispatcher = PxDefaultCpuDispatcherCreate(1);
-			sceneDesc.cpuDispatcher = mCpuDispatcher;
+			cpu_dispatcher = PxDefaultCpuDispatcherCreate(1);
+			sceneDesc.cpuDispatcher = cpu_dispatcher;
 		}
 
 		sceneDesc.filterShader = filter_shader;
@@ -261,6 +404,9 @@ namespace PhysicsEngine
 		pause = false;
 
 		selected_actor = 0;
+		selected_index = 0;
+		drag_anchor = 0;
+		drag_spring = 0;
 
 		SelectNextActor();
 	}
@@ -281,14 +427,63 @@ namespace PhysicsEngine
 		px_scene->addActor(*actor->Get());
 	}
 
+	void Scene::Add(Actor** actors, PxU32 num_actors)
+	{
+		std::vector<PxActor*> px_actors(num_actors);
+		for (PxU32 i = 0; i < num_actors; i++)
+			px_actors[i] = actors[i]->Get();
+
+		if (px_actors.size())
+			px_scene->addActors(&px_actors.front(), (PxU32)px_actors.size());
+	}
+
+	void Scene::Add(Aggregate* aggregate)
+	{
+		px_scene->addAggregate(*aggregate->Get());
+	}
+
+	ActorPool* Scene::CreatePool(const PxGeometry& geometry, PxU32 size, PxMaterial* material, PxReal density)
+	{
+		pools.push_back(new ActorPool(this, geometry, size, material, density));
+		return pools.back();
+	}
+
 	PxScene* Scene::Get() 
 	{ 
 		return px_scene; 
 	}
 
+	Scene::~Scene()
+	{
+		ReleaseScene();
+	}
+
+	void Scene::ReleasePools()
+	{
+		//the drag spring may hold a pooled actor
+		EndDrag();
+		for (unsigned int i = 0; i < pools.size(); i++)
+			delete pools[i];
+		pools.clear();
+	}
+
+	void Scene::ReleaseScene()
+	{
+		ReleasePools();
+		if (px_scene)
+			px_scene->release();
+		if (cpu_dispatcher)
+			cpu_dispatcher->release();
+		px_scene = 0;
+		cpu_dispatcher = 0;
+	}
+
 	void Scene::Reset()
 	{
-		px_scene->release();
+		//everything is recreated by Init
+		EndDrag();
+		CustomRelease();
+		ReleaseScene();
 		Init();
 	}
 
@@ -309,28 +504,101 @@ namespace PhysicsEngine
 
 	void Scene::SelectNextActor()
 	{
-		std::vector<PxRigidDynamic*> actors(px_scene->getNbActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC));
-		if (actors.size() && (px_scene->getActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC, (PxActor**)&actors.front(), (PxU32)actors.size())))
+		PxU32 count = px_scene->getNbActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC);
+		if (!count)
 		{
-			if (selected_actor)
-			{
-				for (unsigned int i = 0; i < actors.size(); i++)
-					if (selected_actor == actors[i])
-					{
-						HighlightOff(selected_actor);
-						//select the next actor
-						selected_actor = actors[(i+1)%actors.size()];
-						break;
-					}
-			}
-			else
-			{
-				selected_actor = actors[0];
-			}
-			HighlightOn(selected_actor);
+			Select(0);
+			return;
 		}
-		else
-			selected_actor = 0;
+
+		//fetch only the next actor instead of all of them
+		PxU32 start = selected_actor ? selected_index + 1 : 0;
+		for (PxU32 i = 0; i < count; i++)
+		{
+			PxU32 index = (start + i) % count;
+			PxActor* actor = 0;
+			px_scene->getActors(PxActorTypeSelectionFlag::eRIGID_DYNAMIC, &actor, 1, index);
+
+			//kinematic actors (the drag anchor among them) cannot be selected
+			PxRigidDynamic* dynamic = (PxRigidDynamic*)actor;
+			if (!dynamic || (dynamic == drag_anchor) || (dynamic->getRigidDynamicFlags() & PxRigidDynamicFlag::eKINEMATIC))
+				continue;
+
+			selected_index = index;
+			Select(dynamic);
+			return;
+		}
+		Select(0);
+	}
+
+	void Scene::Select(PxRigidDynamic* actor)
+	{
+		if (actor == selected_actor)
+			return;
+
+		EndDrag();
+		if (selected_actor)
+			HighlightOff(selected_actor);
+		selected_actor = actor;
+		if (selected_actor)
+			HighlightOn(selected_actor);
+	}
+
+	bool Scene::Pick(const PxVec3& origin, const PxVec3& direction, PxVec3& point, PxReal max_distance)
+	{
+		PxRaycastBuffer hit;
+		if (!px_scene->raycast(origin, direction.getNormalized(), max_distance, hit, PxHitFlags(PxHitFlag::eDEFAULT),
+			PxQueryFilterData(PxQueryFlag::eSTATIC | PxQueryFlag::eDYNAMIC)) || !hit.hasBlock)
+			return false;
+
+		//static geometry in front blocks the ray, kinematic actors cannot be dragged
+		PxRigidDynamic* actor = hit.block.actor->isRigidDynamic();
+		if (!actor || (actor->getRigidDynamicFlags() & PxRigidDynamicFlag::eKINEMATIC))
+			return false;
+
+		Select(actor);
+		point = hit.block.position;
+		return true;
+	}
+
+	void Scene::StartDrag(const PxVec3& point)
+	{
+		EndDrag();
+		if (!selected_actor)
+			return;
+
+		drag_anchor = GetPhysics()->createRigidDynamic(PxTransform(point));
+		drag_anchor->setRigidDynamicFlag(PxRigidDynamicFlag::eKINEMATIC, true);
+		px_scene->addActor(*drag_anchor);
+
+		//a stiff, nearly critically damped spring of zero length, scaled by the mass so that all actors follow alike
+		PxTransform local_point = selected_actor->getGlobalPose().getInverse() * PxTransform(point);
+		drag_spring = PxDistanceJointCreate(*GetPhysics(), drag_anchor, PxTransform(PxIdentity), selected_actor, local_point);
+		drag_spring->setMaxDistance(0.f);
+		drag_spring->setDistanceJointFlag(PxDistanceJointFlag::eMAX_DISTANCE_ENABLED, true);
+		drag_spring->setDistanceJointFlag(PxDistanceJointFlag::eSPRING_ENABLED, true);
+		drag_spring->setStiffness(100.f * selected_actor->getMass());
+		drag_spring->setDamping(15.f * selected_actor->getMass());
+		selected_actor->wakeUp();
+	}
+
+	void Scene::Drag(const PxVec3& point)
+	{
+		if (!drag_anchor)
+			return;
+
+		drag_anchor->setKinematicTarget(PxTransform(point));
+		selected_actor->wakeUp();
+	}
+
+	void Scene::EndDrag()
+	{
+		if (drag_spring)
+			drag_spring->release();
+		if (drag_anchor)
+			drag_anchor->release();
+		drag_spring = 0;
+		drag_anchor = 0;
 	}
 
 	std::vector<PxActor*> Scene::GetAllActors()
@@ -345,26 +613,205 @@ namespace PhysicsEngine
 	void Scene::HighlightOn(PxRigidDynamic* actor)
 	{
 		//store the original colour and adjust brightness of the selected actor
-		std::vector<PxShape*> shapes(actor->getNbShapes());
-		actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
-
 		sactor_color_orig.clear();
 
-		for (unsigned int i = 0; i < shapes.size(); i++)
+		//shapes are fetched in small batches, without allocating
+		PxShape* shapes[8];
+		for (PxU32 first = 0, count; (count = actor->getShapes(shapes, 8, first)) > 0; first += count)
 		{
-			PxVec3* color = ((UserData*)shapes[i]->userData)->color;
-			sactor_color_orig.push_back(*color);
-			*color += PxVec3(.2f,.2f,.2f);
+			for (PxU32 i = 0; i < count; i++)
+			{
+				PxVec3* color = ((UserData*)shapes[i]->userData)->color;
+				sactor_color_orig.push_back(*color);
+				*color += PxVec3(.2f,.2f,.2f);
+			}
 		}
 	}
 
 	void Scene::HighlightOff(PxRigidDynamic* actor)
 	{
 		//restore the original color
-		std::vector<PxShape*> shapes(actor->getNbShapes());
-		actor->getShapes((PxShape**)&shapes.front(), (PxU32)shapes.size());
+		PxShape* shapes[8];
+		for (PxU32 first = 0, count; (count = actor->getShapes(shapes, 8, first)) > 0; first += count)
+		{
+			for (PxU32 i = 0; (i < count) && (first + i < sactor_color_orig.size()); i++)
+				*((UserData*)shapes[i]->userData)->color = sactor_color_orig[first + i];
+		}
+	}
+
+	///SceneClone methods
+	SceneClone::SceneClone(Scene* source)
+	{
+		PxScene* source_scene = source->Get();
+
+		PxSceneDesc sceneDesc(GetPhysics()->getTolerancesScale());
+		cpu_dispatcher = PxDefaultCpuDispatcherCreate(1);
+		sceneDesc.cpuDispatcher = cpu_dispatcher;
+		sceneDesc.filterShader = source_scene->getFilterShader();
+
+		px_scene = GetPhysics()->createScene(sceneDesc);
+
+		if (!px_scene)
+			throw new Exception("PhysicsEngine::SceneClone, Could not initialise the scene.");
+
+		px_scene->setGravity(source_scene->getGravity());
 
-		for (unsigned int i = 0; i < shapes.size(); i++)
-			*((UserData*)shapes[i]->userData)->color = sactor_color_orig[i];
+		//actors
+		PxActorTypeSelectionFlags selection_flag = PxActorTypeSelectionFlag::eRIGID_DYNAMIC | PxActorTypeSelectionFlag::eRIGID_STATIC;
+		std::vector<PxActor*> actors(source_scene->getNbActors(selection_flag));
+		if (actors.size())
+			source_scene->getActors(selection_flag, &actors.front(), (PxU32)actors.size());
+
+		for (unsigned int i = 0; i < actors.size(); i++)
+		{
+			PxRigidActor* clone;
+			if (actors[i]->isRigidDynamic())
+			{
+				PxRigidDynamic* dynamic = (PxRigidDynamic*)actors[i];
+				clone = PxCloneDynamic(*GetPhysics(), dynamic->getGlobalPose(), *dynamic);
+				source_dynamics.push_back(dynamic);
+				dynamics.push_back((PxRigidDynamic*)clone);
+			}
+			else
+			{
+				PxRigidActor* rigid = (PxRigidActor*)actors[i];
+				clone = PxCloneStatic(*GetPhysics(), rigid->getGlobalPose(), *rigid);
+			}
+			actor_map[actors[i]] = clone;
+			px_scene->addActor(*clone);
+		}
+
+		//joints
+		std::vector<PxConstraint*> constraints(source_scene->getNbConstraints());
+		if (constraints.size())
+			source_scene->getConstraints(&constraints.front(), (PxU32)constraints.size());
+
+		for (unsigned int i = 0; i < constraints.size(); i++)
+		{
+			PxU32 type_id;
+			void* external = constraints[i]->getExternalReference(type_id);
+			if (type_id != PxConstraintExtIDs::eJOINT)
+				continue;
+
+			PxJoint* joint = (PxJoint*)external;
+			PxJoint* clone = CloneJoint(joint);
+			if (!clone)
+				continue;
+
+			joint_map[joint] = clone;
+			joints.push_back(clone);
+			if (joint->getConcreteType() == PxJointConcreteType::eREVOLUTE)
+			{
+				source_drives.push_back((PxRevoluteJoint*)joint);
+				drives.push_back((PxRevoluteJoint*)clone);
+			}
+		}
+	}
+
+	SceneClone::~SceneClone()
+	{
+		for (unsigned int i = 0; i < joints.size(); i++)
+			joints[i]->release();
+
+		for (std::map<PxActor*, PxRigidActor*>::iterator it = actor_map.begin(); it != actor_map.end(); ++it)
+			it->second->release();
+
+		px_scene->release();
+		cpu_dispatcher->release();
+	}
+
+	PxJoint* SceneClone::CloneJoint(PxJoint* joint)
+	{
+		PxRigidActor *actor0, *actor1;
+		joint->getActors(actor0, actor1);
+		PxRigidActor* clone0 = actor0 ? Find(actor0) : 0;
+		PxRigidActor* clone1 = actor1 ? Find(actor1) : 0;
+		PxTransform local0 = joint->getLocalPose(PxJointActorIndex::eACTOR0);
+		PxTransform local1 = joint->getLocalPose(PxJointActorIndex::eACTOR1);
+
+		switch (joint->getConcreteType())
+		{
+		case PxJointConcreteType::eREVOLUTE:
+		{
+			PxRevoluteJoint* source = (PxRevoluteJoint*)joint;
+			PxRevoluteJoint* clone = PxRevoluteJointCreate(*GetPhysics(), clone0, local0, clone1, local1);
+			clone->setLimit(source->getLimit());
+			clone->setDriveVelocity(source->getDriveVelocity());
+			clone->setRevoluteJointFlags(source->getRevoluteJointFlags());
+			return clone;
+		}
+		case PxJointConcreteType::eDISTANCE:
+		{
+			PxDistanceJoint* source = (PxDistanceJoint*)joint;
+			PxDistanceJoint* clone = PxDistanceJointCreate(*GetPhysics(), clone0, local0, clone1, local1);
+			clone->setMinDistance(source->getMinDistance());
+			clone->setMaxDistance(source->getMaxDistance());
+			clone->setStiffness(source->getStiffness());
+			clone->setDamping(source->getDamping());
+			clone->setDistanceJointFlags(source->getDistanceJointFlags());
+			return clone;
+		}
+		default:
+			return 0;
+		}
+	}
+
+	void SceneClone::Capture(SceneState& state)
+	{
+		state.poses.resize(source_dynamics.size());
+		state.linear_velocities.resize(source_dynamics.size());
+		state.angular_velocities.resize(source_dynamics.size());
+		for (unsigned int i = 0; i < source_dynamics.size(); i++)
+		{
+			state.poses[i] = source_dynamics[i]->getGlobalPose();
+			state.linear_velocities[i] = source_dynamics[i]->getLinearVelocity();
+			state.angular_velocities[i] = source_dynamics[i]->getAngularVelocity();
+		}
+
+		state.drive_velocities.resize(source_drives.size());
+		for (unsigned int i = 0; i < source_drives.size(); i++)
+			state.drive_velocities[i] = source_drives[i]->getDriveVelocity();
+	}
+
+	void SceneClone::Restore(const SceneState& state)
+	{
+		for (unsigned int i = 0; i < dynamics.size(); i++)
+		{
+			dynamics[i]->setGlobalPose(state.poses[i]);
+			dynamics[i]->setLinearVelocity(state.linear_velocities[i]);
+			dynamics[i]->setAngularVelocity(state.angular_velocities[i]);
+		}
+
+		for (unsigned int i = 0; i < drives.size(); i++)
+			drives[i]->setDriveVelocity(state.drive_velocities[i]);
+	}
+
+	void SceneClone::Update(PxReal dt)
+	{
+		px_scene->simulate(dt);
+		px_scene->fetchResults(true);
+	}
+
+	PxRigidActor* SceneClone::Find(PxActor* source_actor)
+	{
+		std::map<PxActor*, PxRigidActor*>::iterator it = actor_map.find(source_actor);
+		if (it != actor_map.end())
+			return it->second;
+		else
+			return 0;
+	}
+
+	PxJoint* SceneClone::Find(PxJoint* source_joint)
+	{
+		std::map<PxJoint*, PxJoint*>::iterator it = joint_map.find(source_joint);
+		if (it != joint_map.end())
+			return it->second;
+		else
+			return 0;
+	}
+
+	PxScene* SceneClone::Get()
+	{
+		return px_scene;
 	}
-}
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include "PxPhysicsAPI.h"
 #include "Exception.h"
 #include "Extras\UserData.h"
@@ -23,6 +24,9 @@ namespace PhysicsEngine
 	///Get the cooking object
 	PxCooking* GetCooking();
 
+	///Number of PhysX allocations so far (from all threads)
+	PxU32 Allocations();
+
 	///Get the specified material
 	PxMaterial* GetMaterial(PxU32 index=0);
 
@@ -47,6 +51,8 @@ namespace PhysicsEngine
 		{
 		}
 
+		virtual ~Actor() {}
+
 		PxActor* Get();
 
 		void Color(PxVec3 new_color, PxU32 shape_index=-1);
@@ -92,27 +98,121 @@ namespace PhysicsEngine
 		void CreateShape(const PxGeometry& geometry, PxReal density=0.f);
 	};
 
+	///Dynamic actor owned by an ActorPool
+	class PooledActor : public DynamicActor
+	{
+		friend class ActorPool;
+		PxU32 pool_index;
+		bool active;
+
+	public:
+		PooledActor(const PxTransform& pose) : DynamicActor(pose), pool_index(0), active(false) {}
+
+		bool Active() { return active; }
+	};
+
+	class Scene;
+
+	///Actor pool class
+	///Preallocates dynamic actors with the same geometry and recycles them
+	class ActorPool
+	{
+		Scene* scene;
+		std::vector<PooledActor*> actors;
+		std::vector<PxU32> free_list;
+
+	public:
+		///Constructor: create 'size' parked actors
+		ActorPool(Scene* scene, const PxGeometry& geometry, PxU32 size, PxMaterial* material=0, PxReal density=1.f);
+
+		~ActorPool();
+
+		///Take a parked actor, place it in the scene with the given pose and velocity
+		///returns 0 if the pool is exhausted
+		PooledActor* Activate(const PxTransform& pose, const PxVec3& velocity=PxVec3(0.f,0.f,0.f));
+
+		///Remove the actor from the scene and park it for later reuse
+		void Release(PooledActor* actor);
+
+		///Park all active actors
+		void ReleaseAll();
+
+		///Number of actors currently in the scene
+		PxU32 Active();
+
+		///Total number of actors in the pool
+		PxU32 Size();
+
+		///Fraction of the pool in use
+		PxReal Occupancy();
+	};
+
+	///Aggregate class
+	///Groups related actors into a single broadphase entry
+	class Aggregate
+	{
+	protected:
+		PxAggregate* aggregate;
+
+	public:
+		///Constructor
+		Aggregate(PxU32 max_actors, bool self_collision=true);
+
+		///Release the aggregate (the actors stay, in the scene if the aggregate was in one)
+		~Aggregate();
+
+		//owns the PxAggregate, copies would release it twice
+		Aggregate(const Aggregate&) = delete;
+		Aggregate& operator=(const Aggregate&) = delete;
+
+		PxAggregate* Get();
+
+		///Add an actor to the aggregate (before adding the aggregate to the scene)
+		void Add(Actor* actor);
+
+		///Add an array of actors to the aggregate
+		void Add(Actor** actors, PxU32 num_actors);
+	};
+
 	///Generic scene class
 	class Scene
 	{
 	protected:
 		//a PhysX scene object
 		PxScene* px_scene;
+		PxDefaultCpuDispatcher* cpu_dispatcher;
 		//pause simulation
 		bool pause;
-		//selected dynamic actor on the scene
+		//selected dynamic actor on the scene and its index for SelectNextActor
 		PxRigidDynamic* selected_actor;
+		PxU32 selected_index;
 		//original and modified colour of the selected actor
 		std::vector<PxVec3> sactor_color_orig;
+		//dragging: a kinematic anchor pulls the selected actor through a spring
+		PxRigidDynamic* drag_anchor;
+		PxDistanceJoint* drag_spring;
 		//custom filter shader
 		PxSimulationFilterShader filter_shader;
+		//actor pools owned by the scene
+		std::vector<ActorPool*> pools;
 
 		void HighlightOn(PxRigidDynamic* actor);
 
 		void HighlightOff(PxRigidDynamic* actor);
 
+		//stop dragging and delete the pools with their actors
+		void ReleasePools();
+
+		//release the pools, the PhysX scene and its dispatcher
+		void ReleaseScene();
+
 	public:
-		Scene(PxSimulationFilterShader custom_filter_shader=PxDefaultSimulationFilterShader) : filter_shader(custom_filter_shader) {}
+		Scene(PxSimulationFilterShader custom_filter_shader=PxDefaultSimulationFilterShader)
+			: px_scene(0), cpu_dispatcher(0), pause(false), selected_actor(0), selected_index(0), drag_anchor(0), drag_spring(0), filter_shader(custom_filter_shader) {}
+
+		///Release the actor pools and the PhysX scene
+		///(derived scenes release the objects of CustomInit in their own destructor)
+		virtual ~Scene();
 
 		///Init the scene
 		void Init();
@@ -120,6 +220,9 @@ namespace PhysicsEngine
 		///User defined initialisation
 		virtual void CustomInit() {}
 
+		///User defined release of the objects created by CustomInit (called by Reset)
+		virtual void CustomRelease() {}
+
 		///Perform a single simulation step
 		void Update(PxReal dt);
 
@@ -129,6 +232,15 @@ namespace PhysicsEngine
 		///Add actors
 		void Add(Actor* actor);
 
+		///Add an array of actors in a single batch
+		void Add(Actor** actors, PxU32 num_actors);
+
+		///Add an aggregate (group of actors)
+		void Add(Aggregate* aggregate);
+
+		///Create a pool of preallocated dynamic actors (released on Reset)
+		ActorPool* CreatePool(const PxGeometry& geometry, PxU32 size, PxMaterial* material=0, PxReal density=1.f);
+
 		///Get the PxScene object
 		PxScene* Get();
 
@@ -147,10 +259,77 @@ namespace PhysicsEngine
 		///Switch to the next dynamic actor
 		void SelectNextActor();
 
+		///Select a dynamic actor (0 for none)
+		void Select(PxRigidDynamic* actor);
+
+		///Select the dynamic actor hit by a ray (e.g. from the camera through the mouse cursor) with a single scene query.
+		///Returns false if no dynamic actor was hit, otherwise the hit point.
+		bool Pick(const PxVec3& origin, const PxVec3& direction, PxVec3& point, PxReal max_distance=1000.f);
+
+		///Start dragging the selected actor by a point on it (world space)
+		void StartDrag(const PxVec3& point);
+
+		///Move the drag point, the actor follows it on a spring
+		void Drag(const PxVec3& point);
+
+		///Stop dragging
+		void EndDrag();
+
 		///a list with all actors
 		std::vector<PxActor*> GetAllActors();
 	};
 
+	///State of the dynamic actors and joint drives of a scene
+	struct SceneState
+	{
+		std::vector<PxTransform> poses;
+		std::vector<PxVec3> linear_velocities;
+		std::vector<PxVec3> angular_velocities;
+		std::vector<PxReal> drive_velocities;
+	};
+
+	///Private copy of a scene: static geometry, dynamic actors and joints.
+	///Shapes reference the same cooked meshes and materials as the original.
+	///Capture reads the original scene (call it between simulation steps),
+	///all other methods only touch the copy and can run on another thread.
+	class SceneClone
+	{
+		PxScene* px_scene;
+		PxDefaultCpuDispatcher* cpu_dispatcher;
+		//original -> copy
+		std::map<PxActor*, PxRigidActor*> actor_map;
+		std::map<PxJoint*, PxJoint*> joint_map;
+		//dynamic actors and revolute drives, source and copy at the same index
+		std::vector<PxRigidDynamic*> source_dynamics, dynamics;
+		std::vector<PxRevoluteJoint*> source_drives, drives;
+		std::vector<PxJoint*> joints;
+
+		PxJoint* CloneJoint(PxJoint* joint);
+
+	public:
+		SceneClone(Scene* source);
+
+		~SceneClone();
+
+		///Copy the current state of the original scene
+		void Capture(SceneState& state);
+
+		///Apply a captured state to the copy
+		void Restore(const SceneState& state);
+
+		///Perform a single simulation step of the copy
+		void Update(PxReal dt);
+
+		///Get the copy of an actor from the original scene
+		PxRigidActor* Find(PxActor* source_actor);
+
+		///Get the copy of a joint from the original scene
+		PxJoint* Find(PxJoint* source_joint);
+
+		///Get the PxScene object of the copy
+		PxScene* Get();
+	};
+
 	///Generic Joint class
 	class Joint
 	{
@@ -160,6 +339,12 @@ namespace PhysicsEngine
 	public:
 		Joint() : joint(0) {}
 
+		virtual ~Joint()
+		{
+			if (joint)
+				joint->release();
+		}
+
 		PxJoint* Get() { return joint; }
 	};
 
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "MyPhysicsEngine.h"
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <ostream>
+#include <iomanip>
+
+namespace PhysicsEngine
+{
+	///Outcome of a single headless shot
+	struct ShotResult
+	{
+		PxReal force;
+		bool success;
+		//time until the ball reached the 'hole'
+		PxReal time;
+	};
+
+	///Finds the forces that sink the ball for every 'hole' position (level-design QA).
+	///Each layout is initialised once and its reset state is copied into one private scene per thread,
+	///sharing cooked meshes and materials. Every rollout restores that snapshot instead of re-running CustomInit.
+	class ShotOptimiser
+	{
+		PxReal min_force, max_force;
+		//number of samples in the coarse sweep
+		PxU32 grid_size;
+		//bisection steps for each edge between a miss and a success
+		PxU32 refine_steps;
+		//length of a single rollout
+		PxReal duration;
+		//time the ball is left to settle before the snapshot is taken
+		PxReal settle_time;
+		PxReal time_step;
+		PxU32 num_threads;
+
+		///Private copy of the scene used by one thread
+		struct Worker
+		{
+			SceneClone* clone;
+			PxRigidActor* ball;
+			PxRigidActor* hole;
+			PxRevoluteJoint* club_drive;
+		};
+
+		std::vector<Worker> workers;
+		SceneState reset_state;
+
+	public:
+		ShotOptimiser(PxReal _min_force=-8.f, PxReal _max_force=8.f, PxU32 _grid_size=33, PxU32 _refine_steps=6,
+			PxReal _duration=10.f, PxReal _settle_time=2.f, PxReal _time_step=1.f/60.f, PxU32 _num_threads=0)
+			: min_force(_min_force), max_force(_max_force), grid_size(PxMax(_grid_size, 2u)), refine_steps(_refine_steps),
+			duration(_duration), settle_time(_settle_time), time_step(_time_step), num_threads(_num_threads)
+		{
+			if (!num_threads)
+				num_threads = PxMax(std::thread::hardware_concurrency(), 1u);
+		}
+
+		///Optimise all 'hole' positions and print a success map for each of them
+		void Run(std::ostream& out)
+		{
+			for (int hole = 0; hole < MyScene::numHoles; hole++)
+			{
+				std::vector<ShotResult> coarse, samples;
+				PxVec3 hole_position = Optimise(hole, coarse, samples);
+				Report(out, hole, hole_position, coarse, samples);
+			}
+		}
+
+		///Sweep the force range for a single 'hole' position, then refine the edges of the successful ranges.
+		///Returns the position of the 'hole'; 'samples' holds every rollout sorted by force.
+		PxVec3 Optimise(int hole, std::vector<ShotResult>& coarse, std::vector<ShotResult>& samples)
+		{
+			//initialise the layout once and let it settle
+			MyScene* scene = new MyScene();
+			scene->fixedHole = hole;
+			scene->Init();
+			for (PxReal t = 0.f; t < settle_time; t += time_step)
+				scene->Update(time_step);
+
+			PxVec3 hole_position = ((PxRigidActor*)scene->Hole()->Get())->getGlobalPose().p;
+
+			workers.resize(num_threads);
+			for (unsigned int i = 0; i < workers.size(); i++)
+			{
+				workers[i].clone = new SceneClone(scene);
+				workers[i].ball = workers[i].clone->Find(scene->GolfBall()->Get());
+				workers[i].hole = workers[i].clone->Find(scene->Hole()->Get());
+				workers[i].club_drive = (PxRevoluteJoint*)workers[i].clone->Find(scene->GolfClub()->Get());
+			}
+			workers[0].clone->Capture(reset_state);
+
+			//coarse sweep
+			coarse.resize(grid_size);
+			Parallel(grid_size, [&](Worker& worker, PxU32 i)
+			{
+				coarse[i] = Rollout(worker, min_force + (max_force - min_force) * i / (grid_size - 1));
+			});
+
+			//bisection on every edge between a miss and a success
+			std::vector<PxU32> edges;
+			for (PxU32 i = 0; i + 1 < grid_size; i++)
+				if (coarse[i].success != coarse[i + 1].success)
+					edges.push_back(i);
+
+			std::vector<std::vector<ShotResult> > refined(edges.size());
+			Parallel((PxU32)edges.size(), [&](Worker& worker, PxU32 i)
+			{
+				ShotResult low = coarse[edges[i]];
+				ShotResult high = coarse[edges[i] + 1];
+				for (PxU32 step = 0; step < refine_steps; step++)
+				{
+					ShotResult middle = Rollout(worker, (low.force + high.force) * .5f);
+					refined[i].push_back(middle);
+					if (middle.success == low.success)
+						low = middle;
+					else
+						high = middle;
+				}
+			});
+
+			samples = coarse;
+			for (unsigned int i = 0; i < refined.size(); i++)
+				samples.insert(samples.end(), refined[i].begin(), refined[i].end());
+			std::sort(samples.begin(), samples.end(), [](const ShotResult& a, const ShotResult& b) { return a.force < b.force; });
+
+			for (unsigned int i = 0; i < workers.size(); i++)
+				delete workers[i].clone;
+			workers.clear();
+			delete scene;
+
+			return hole_position;
+		}
+
+	private:
+		///Restore the snapshot and play a single shot
+		ShotResult Rollout(Worker& worker, PxReal force)
+		{
+			ShotResult result = { force, false, 0.f };
+
+			worker.clone->Restore(reset_state);
+
+			//same as MyScene::push
+			worker.club_drive->setDriveVelocity(-force);
+			worker.club_drive->setRevoluteJointFlag(PxRevoluteJointFlag::eDRIVE_ENABLED, true);
+
+			PxShape *ball_shape, *hole_shape;
+			worker.ball->getShapes(&ball_shape, 1);
+			worker.hole->getShapes(&hole_shape, 1);
+			PxGeometryHolder ball_geometry = ball_shape->getGeometry();
+			PxGeometryHolder hole_geometry = hole_shape->getGeometry();
+			PxTransform hole_pose = PxShapeExt::getGlobalPose(*hole_shape, *worker.hole);
+
+			for (PxReal t = 0.f; t < duration; t += time_step)
+			{
+				worker.clone->Update(time_step);
+
+				//the ball touching the 'hole' wins the game (see MySimulationEventCallback::onTrigger)
+				if (PxGeometryQuery::overlap(ball_geometry.any(), PxShapeExt::getGlobalPose(*ball_shape, *worker.ball), hole_geometry.any(), hole_pose))
+				{
+					result.success = true;
+					result.time = t + time_step;
+					break;
+				}
+			}
+
+			return result;
+		}
+
+		///Run task(worker, index) for index = 0..count-1, spread over the worker threads
+		template<class Task>
+		void Parallel(PxU32 count, Task task)
+		{
+			std::atomic<PxU32> next(0);
+			std::vector<std::thread> threads;
+			for (unsigned int i = 0; i < workers.size(); i++)
+			{
+				Worker* worker = &workers[i];
+				threads.push_back(std::thread([&next, &task, worker, count]()
+				{
+					for (PxU32 index = next++; index < count; index = next++)
+						task(*worker, index);
+				}));
+			}
+
+			for (unsigned int i = 0; i < threads.size(); i++)
+				threads[i].join();
+		}
+
+		///Print the success map of a single 'hole' position
+		void Report(std::ostream& out, int hole, const PxVec3& position, const std::vector<ShotResult>& coarse, const std::vector<ShotResult>& samples)
+		{
+			out << "Hole " << hole << " at (" << position.x << ", " << position.y << ", " << position.z << ")" << std::endl;
+
+			//coarse map: '#' sinks the ball, '.' misses
+			std::string map;
+			for (unsigned int i = 0; i < coarse.size(); i++)
+				map += coarse[i].success ? '#' : '.';
+			out << std::fixed << std::setprecision(2);
+			out << "  " << min_force << " [" << map << "] " << max_force << std::endl;
+
+			//successful ranges: the width tells how much the force may be off
+			bool found = false;
+			for (unsigned int i = 0; i < samples.size(); i++)
+			{
+				if (!samples[i].success)
+					continue;
+
+				unsigned int j = i;
+				while ((j + 1 < samples.size()) && samples[j + 1].success)
+					j++;
+
+				out << "  sinks for force in [" << samples[i].force << ", " << samples[j].force << "]"
+					<< " width " << (samples[j].force - samples[i].force)
+					<< " best " << (samples[i].force + samples[j].force) * .5f << std::endl;
+				found = true;
+				i = j;
+			}
+
+			if (!found)
+				out << "  no force sinks the ball" << std::endl;
+
+			out.unsetf(std::ios::floatfield);
+		}
+	};
+}
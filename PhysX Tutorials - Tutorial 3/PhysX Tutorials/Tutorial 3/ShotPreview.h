@@ -0,0 +1,154 @@
+#pragma once
+
+#include "MyPhysicsEngine.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace PhysicsEngine
+{
+	///Predicts the path of the golf ball for the current force.
+	///The scene is copied into a private PxScene that is simulated ahead on a worker thread,
+	///so the main simulation never waits for a prediction.
+	class ShotPreview
+	{
+		SceneClone* clone;
+		PxRigidActor* ball;
+		PxRevoluteJoint* club_drive;
+		PxReal duration;
+		PxReal time_step;
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable wake_up;
+		bool quit;
+
+		//the latest request, protected by the mutex
+		bool request_pending;
+		SceneState request_state;
+		PxReal request_force;
+		//bumped on every request, a running prediction stops when it changes
+		std::atomic<unsigned int> request_id;
+
+		//the latest finished prediction, protected by the mutex
+		std::vector<PxVec3> result;
+		bool result_ready;
+
+	public:
+		///Copy the scene and start the worker thread
+		ShotPreview(MyScene* scene, PxReal _duration=3.f, PxReal _time_step=1.f/60.f)
+			: duration(_duration), time_step(_time_step), quit(false), request_pending(false), request_force(0.f),
+			request_id(0), result_ready(false)
+		{
+			clone = new SceneClone(scene);
+			ball = clone->Find(scene->GolfBall()->Get());
+			club_drive = (PxRevoluteJoint*)clone->Find(scene->GolfClub()->Get());
+			worker = std::thread(&ShotPreview::Run, this);
+		}
+
+		~ShotPreview()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				quit = true;
+				request_id++;
+			}
+			wake_up.notify_one();
+			worker.join();
+			delete clone;
+		}
+
+		///Request a new prediction for the given force (call between simulation steps).
+		///Any prediction still running is cancelled.
+		void Request(PxReal force)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				clone->Capture(request_state);
+				request_force = force;
+				request_pending = true;
+				request_id++;
+			}
+			wake_up.notify_one();
+		}
+
+		///Get the latest finished prediction, returns false if there is nothing new.
+		///Never blocks: if the worker is publishing a result it is picked up next time.
+		bool Poll(std::vector<PxVec3>& path)
+		{
+			std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+			if (!lock.owns_lock() || !result_ready)
+				return false;
+
+			path.swap(result);
+			result_ready = false;
+			return true;
+		}
+
+	private:
+		void Run()
+		{
+			SceneState state;
+			std::vector<PxVec3> path;
+
+			while (true)
+			{
+				PxReal force;
+				unsigned int id;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					wake_up.wait(lock, [this] { return quit || request_pending; });
+					if (quit)
+						return;
+
+					state.poses.swap(request_state.poses);
+					state.linear_velocities.swap(request_state.linear_velocities);
+					state.angular_velocities.swap(request_state.angular_velocities);
+					state.drive_velocities.swap(request_state.drive_velocities);
+					force = request_force;
+					id = request_id;
+					request_pending = false;
+				}
+
+				if (!Simulate(state, force, id, path))
+					continue;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				//a newer request arrived while finishing, drop this one
+				if (id != request_id)
+					continue;
+				result.swap(path);
+				result_ready = true;
+			}
+		}
+
+		///Run the shot in the private scene, returns false if cancelled
+		bool Simulate(const SceneState& state, PxReal force, unsigned int id, std::vector<PxVec3>& path)
+		{
+			clone->Restore(state);
+
+			//same as MyScene::push
+			if (club_drive)
+			{
+				club_drive->setDriveVelocity(-force);
+				club_drive->setRevoluteJointFlag(PxRevoluteJointFlag::eDRIVE_ENABLED, true);
+			}
+
+			path.clear();
+			path.push_back(ball->getGlobalPose().p);
+
+			PxU32 steps = (PxU32)(duration / time_step);
+			for (PxU32 i = 0; i < steps; i++)
+			{
+				if (id != request_id)
+					return false;
+
+				clone->Update(time_step);
+				path.push_back(ball->getGlobalPose().p);
+			}
+
+			return true;
+		}
+	};
+}
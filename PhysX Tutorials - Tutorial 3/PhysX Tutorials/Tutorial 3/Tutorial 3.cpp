@@ -1,13 +1,52 @@
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
 #include "VisualDebugger.h"
+#include "ShotOptimiser.h"
 
 using namespace std;
 
-int main()
+int main(int argc, char* argv[])
 {
+	//headless mode: print which forces sink the ball for every 'hole' position
+	if ((argc > 1) && (string(argv[1]) == "-optimise"))
+	{
+		try
+		{
+			PhysicsEngine::PxInit();
+			PhysicsEngine::ShotOptimiser optimiser;
+			optimiser.Run(cout);
+			PhysicsEngine::PxRelease();
+		}
+		catch (Exception* exc)
+		{
+			cerr << exc->what() << endl;
+		}
+		return 0;
+	}
+
+	//-scenes N: number of scenes shown side by side, e.g. for comparing physics settings
+	//-record path: record the window to path_00000.ppm, ...
+	//-frames N: exit after recording N frames (replays and regression runs)
+	int num_scenes = 1;
+	string record_path;
+	int record_frames = 0;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		string option(argv[i]);
+		if (option == "-scenes")
+			num_scenes = max(atoi(argv[++i]), 1);
+		else if (option == "-record")
+			record_path = argv[++i];
+		else if (option == "-frames")
+			record_frames = max(atoi(argv[++i]), 0);
+	}
+
 	try 
 	{ 
-		VisualDebugger::Init("Tutorial 3", 800, 800); 
+		VisualDebugger::Init("Tutorial 3", 800, 800, num_scenes); 
+		if (record_path.size())
+			VisualDebugger::Record(record_path, record_frames);
 	}
 	catch (Exception exc) 
 	{ 
@@ -1,8 +1,18 @@
 #include "VisualDebugger.h"
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <sstream>
 #include "Extras\Camera.h"
 #include "Extras\Renderer.h"
 #include "Extras\HUD.h"
+#include "Extras\FrameRecorder.h"
+#include "Extras\LockFree.h"
+#include "Extras\PerfOverlay.h"
+#include "Extras\Input.h"
 
 namespace VisualDebugger
 {
@@ -20,12 +30,14 @@ namespace VisualDebugger
 		EMPTY = 0,
 		HELP = 1,
 		PAUSE = 2,
-		WIN = 3
+		WIN = 3,
+		PERF = 4
 	};
 
 	//function declarations
 	void KeyHold();
 	void KeySpecial(int key, int x, int y);
+	void KeySpecialRelease(int key, int x, int y);
 	void KeyRelease(unsigned char key, int x, int y);
 	void KeyPress(unsigned char key, int x, int y);
 
@@ -34,40 +46,465 @@ namespace VisualDebugger
 	void exitCallback(void);
 
 	void RenderScene();
+	void RenderView(unsigned int index);
 	void ToggleRenderMode();
 	void HUDInit();
+	void SelectView(unsigned int index);
+	bool ViewRect(unsigned int index, int& x, int& y, int& width, int& height);
+	bool ScenesChanged();
+	PxReal HeldForceRate();
+
+	///Input for a scene, handled on its simulation thread
+	enum CommandType
+	{
+		PUSH,
+		ADD_FORCE,
+		FORCE_RATE,
+		PAUSE_TOGGLE,
+		SELECT_NEXT_ACTOR,
+		RESET,
+		PICK,
+		DRAG,
+		END_DRAG
+	};
+
+	struct Command
+	{
+		CommandType type;
+		PxReal value;
+		//time of the input event (Input::Now)
+		double time;
+		//ray for picking and dragging
+		PxVec3 origin;
+		PxVec3 direction;
+		//drag sequence of a PICK or DRAG, a drag belongs to the pick with the same number
+		PxU32 drag;
+	};
+
+	///Everything the render thread needs from a scene, captured after a simulation step
+	struct SceneSnapshot
+	{
+		std::vector<Renderer::ShapeSnapshot> shapes;
+		std::vector<Renderer::ClothSnapshot> cloths;
+		//debug primitives, only captured when they are drawn
+		std::vector<PxDebugPoint> points;
+		std::vector<PxDebugLine> lines;
+		std::vector<PxDebugTriangle> triangles;
+		//predicted path of the golf ball for the current force
+		std::vector<PxVec3> shot_path;
+		PxReal force;
+		bool paused;
+		bool won;
+		//duration of the last steps in ms (smoothed)
+		PxReal step_time;
+		//time the step was published (Input::Now) and the simulated time between steps, for interpolating the poses
+		double time;
+		PxReal time_step;
+		//bumped on every change, the window is redrawn only when it differs from the drawn one
+		PxU32 version;
+		//nothing moves until the next command (paused or every body asleep)
+		bool idle;
+	};
+
+	///Runs a single scene on its own thread at a fixed rate, independent of the frame rate.
+	///The render thread never touches the scene: it reads the latest snapshot and sends commands.
+	class SceneWorker
+	{
+		///Pose of a shape after a step
+		struct ShapePose
+		{
+			const PxRigidActor* actor;
+			const PxShape* shape;
+			PxTransform pose;
+		};
+
+		PhysicsEngine::MyScene* scene;
+		PxReal time_step;
+		std::thread thread;
+		std::atomic<bool> quit;
+		std::atomic<bool> capture_debug;
+		TripleBuffer<SceneSnapshot> snapshots;
+		SPSCQueue<Command, 64> commands;
+		//commands that did not fit into the queue, kept in order on the render thread
+		std::vector<Command> overflow;
+		//only the latest drag ray matters, it is handed over apart from the queue
+		TripleBuffer<Command> drag_rays;
+		std::atomic<bool> drag_pending;
+		//sequence of the last pick sent (render thread) and of the last pick handled (simulation thread)
+		PxU32 sent_drag;
+		PxU32 current_drag;
+		//timing and counters of every step for the performance overlay
+		SPSCQueue<StepSample, 256> step_samples;
+		std::vector<PxActor*> actors;
+		//mesh data shared with the renderer, copied once per mesh on this thread
+		MeshCache::SourceCache sources;
+		//poses of the last published step, in snapshot order
+		std::vector<ShapePose> last_poses;
+		PxReal step_time;
+		//distance of the dragged point from the camera
+		PxReal drag_distance;
+		//state of the last published snapshot
+		PxU32 version;
+		bool idle_published;
+		bool debug_published;
+		//change of the force per second while a key is held, integrated up to force_time
+		PxReal force_rate;
+		double force_time;
+
+		//predicted path of the golf ball for the current force
+		PhysicsEngine::ShotPreview* shot_preview;
+		std::vector<PxVec3> shot_path;
+		PxReal shot_path_force;
+
+		void Run()
+		{
+			typedef std::chrono::high_resolution_clock Clock;
+			Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<PxReal>(time_step));
+			Clock::time_point next_step = Clock::now();
+
+			while (!quit)
+			{
+				bool changed = false;
+				Command command;
+				while (commands.Pop(command))
+				{
+					Execute(command);
+					changed = true;
+				}
+				if (drag_pending.exchange(false))
+				{
+					const Command& drag = drag_rays.Front();
+					if (drag.drag == current_drag)
+					{
+						Execute(drag);
+						changed = true;
+					}
+					//its pick is still waiting in the queue, keep the ray until then
+					else if ((PxI32)(drag.drag - current_drag) > 0)
+						drag_pending = true;
+				}
+				IntegrateForce(Input::Now());
+
+				//PhysX fills the render buffer (and Publish copies it) only while debug primitives are shown
+				PxReal debug_scale = capture_debug ? 1.f : 0.f;
+				if (scene->Get()->getVisualizationParameter(PxVisualizationParameter::eSCALE) != debug_scale)
+					scene->Get()->setVisualizationParameter(PxVisualizationParameter::eSCALE, debug_scale);
+
+				Clock::time_point start = Clock::now();
+				scene->Update(time_step);
+				std::chrono::duration<PxReal, std::milli> elapsed = Clock::now() - start;
+				step_time = step_time*0.95f + elapsed.count()*0.05f;
+
+				PxSimulationStatistics statistics;
+				scene->Get()->getSimulationStatistics(statistics);
+				changed |= !scene->Pause() && (statistics.nbActiveDynamicBodies > 0);
+				changed |= (force_rate != 0.f) || (capture_debug != debug_published);
+				changed |= UpdateShotPreview();
+
+				//a still scene is published once more to tell that it is idle, then not at all
+				if (changed || !idle_published)
+				{
+					Publish(!changed);
+					idle_published = !changed;
+				}
+				Sample(elapsed.count(), statistics);
+
+				next_step += tick;
+				//too far behind (e.g. a breakpoint), do not try to catch up
+				if (Clock::now() > next_step + tick*4)
+					next_step = Clock::now();
+				std::this_thread::sleep_until(next_step);
+			}
+		}
+
+		void Execute(const Command& command)
+		{
+			switch (command.type)
+			{
+			case PUSH:
+				scene->push();
+				break;
+			case ADD_FORCE:
+				scene->myForce += command.value;
+				break;
+			case FORCE_RATE:
+				//the old rate applies until the key event, not until the command arrives
+				IntegrateForce(command.time);
+				force_rate = command.value;
+				break;
+			case PAUSE_TOGGLE:
+				scene->Pause(!scene->Pause());
+				break;
+			case SELECT_NEXT_ACTOR:
+				scene->SelectNextActor();
+				break;
+			case RESET:
+				scene->myForce = 0;
+				scene->hasWon = false;
+				scene->Reset();
+				//the scene content is new, copy it again
+				ResetShotPreview();
+				//actors jump back to the start, do not blend into it
+				last_poses.clear();
+				break;
+			case PICK:
+				{
+					//one raycast, the actor is dragged at the same distance from the camera
+					current_drag = command.drag;
+					PxVec3 point;
+					if (scene->Pick(command.origin, command.direction, point))
+					{
+						drag_distance = (point - command.origin).magnitude();
+						scene->StartDrag(point);
+					}
+				}
+				break;
+			case DRAG:
+				scene->Drag(command.origin + command.direction*drag_distance);
+				break;
+			case END_DRAG:
+				scene->EndDrag();
+				break;
+			}
+		}
+
+		//change the force by the held rate from force_time up to time
+		void IntegrateForce(double time)
+		{
+			if (time > force_time)
+			{
+				scene->myForce += force_rate * (PxReal)(time - force_time);
+				force_time = time;
+			}
+		}
+
+		//Copy the scene into a new shot preview (after init or reset)
+		void ResetShotPreview()
+		{
+			delete shot_preview;
+			shot_preview = new PhysicsEngine::ShotPreview(scene);
+			shot_preview->Request(scene->myForce);
+			shot_path_force = scene->myForce;
+			shot_path.clear();
+		}
+
+		//request a new prediction when the force changes and pick up the latest one, returns true if the path changed
+		bool UpdateShotPreview()
+		{
+			if (scene->myForce != shot_path_force)
+			{
+				shot_preview->Request(scene->myForce);
+				shot_path_force = scene->myForce;
+			}
+			return shot_preview->Poll(shot_path);
+		}
+
+		void Publish(bool idle)
+		{
+			SceneSnapshot& snapshot = snapshots.Back();
+
+			actors = scene->GetAllActors();
+			Renderer::Snapshot(actors.size() ? &actors[0] : 0, (PxU32)actors.size(), snapshot.shapes, snapshot.cloths, sources);
+			InterpolateFrom(snapshot.shapes);
+
+			snapshot.points.clear();
+			snapshot.lines.clear();
+			snapshot.triangles.clear();
+			debug_published = capture_debug;
+			if (debug_published)
+			{
+				const PxRenderBuffer& data = scene->Get()->getRenderBuffer();
+				snapshot.points.assign(data.getPoints(), data.getPoints() + data.getNbPoints());
+				snapshot.lines.assign(data.getLines(), data.getLines() + data.getNbLines());
+				snapshot.triangles.assign(data.getTriangles(), data.getTriangles() + data.getNbTriangles());
+			}
+
+			snapshot.shot_path = shot_path;
+			snapshot.force = scene->myForce;
+			snapshot.paused = scene->Pause();
+			snapshot.won = scene->hasWon;
+			snapshot.step_time = step_time;
+			snapshot.time = Input::Now();
+			snapshot.time_step = time_step;
+			snapshot.version = ++version;
+			snapshot.idle = idle;
+
+			snapshots.Publish();
+		}
+
+		//set the previous poses of the shapes to the last published ones and keep the new ones.
+		//the order only changes when actors are added or removed, new shapes start without motion.
+		void InterpolateFrom(std::vector<Renderer::ShapeSnapshot>& shapes)
+		{
+			for (PxU32 i = 0; i < shapes.size(); i++)
+			{
+				Renderer::ShapeSnapshot& shape = shapes[i];
+				if ((i < last_poses.size()) && (last_poses[i].actor == shape.actor) && (last_poses[i].shape == shape.shape))
+					shape.previous_pose = last_poses[i].pose;
+			}
+
+			last_poses.resize(shapes.size());
+			for (PxU32 i = 0; i < shapes.size(); i++)
+			{
+				last_poses[i].actor = shapes[i].actor;
+				last_poses[i].shape = shapes[i].shape;
+				last_poses[i].pose = shapes[i].pose;
+			}
+		}
+
+		//actors is filled by Publish
+		void Sample(PxReal elapsed, const PxSimulationStatistics& statistics)
+		{
+			StepSample sample;
+			sample.step_time = elapsed;
+			sample.actors = (PxU32)actors.size();
+			sample.active_bodies = statistics.nbActiveDynamicBodies;
+			sample.contacts = statistics.nbDiscreteContactPairsWithContacts;
+			//dropped if nobody reads them
+			step_samples.Push(sample);
+		}
+
+	public:
+		SceneWorker(PhysicsEngine::MyScene* _scene, PxReal _time_step)
+			: scene(_scene), time_step(_time_step), quit(false), capture_debug(false), drag_pending(false), sent_drag(0), current_drag(0), step_time(0.f), drag_distance(0.f),
+			version(0), idle_published(false), debug_published(false), force_rate(0.f), force_time(Input::Now()), shot_preview(0)
+		{
+			ResetShotPreview();
+			//something to draw before the first step
+			Publish(false);
+			thread = std::thread(&SceneWorker::Run, this);
+		}
+
+		~SceneWorker()
+		{
+			quit = true;
+			thread.join();
+			delete shot_preview;
+		}
+
+		///Queue a command for the scene, it waits on the render thread if the queue is full
+		void Send(CommandType type, PxReal value=0.f)
+		{
+			Command command = { type, value, Input::Now() };
+			Send(command);
+		}
+
+		///Queue a command with a ray (picking and dragging), only the latest drag is kept.
+		///Drags are skipped by the scene until it has handled their pick.
+		void Send(CommandType type, const PxVec3& origin, const PxVec3& direction)
+		{
+			if (type == PICK)
+				sent_drag++;
+			Command command = { type, 0.f, Input::Now(), origin, direction, sent_drag };
+			if (type == DRAG)
+			{
+				drag_rays.Back() = command;
+				drag_rays.Publish();
+				drag_pending = true;
+			}
+			else
+				Send(command);
+		}
+
+		void Send(const Command& command)
+		{
+			Flush();
+			if (!overflow.empty() || !commands.Push(command))
+				overflow.push_back(command);
+		}
+
+		///Move waiting commands into the queue as far as they fit, returns true if some are still waiting
+		bool Flush()
+		{
+			PxU32 count = 0;
+			while ((count < overflow.size()) && commands.Push(overflow[count]))
+				count++;
+			overflow.erase(overflow.begin(), overflow.begin() + count);
+			return !overflow.empty();
+		}
+
+		///The latest snapshot of the scene (render thread only)
+		const SceneSnapshot& Latest()
+		{
+			return snapshots.Front();
+		}
+
+		///Take the oldest step sample, returns false if there is none
+		bool PopStep(StepSample& sample)
+		{
+			return step_samples.Pop(sample);
+		}
+
+		///Capture the debug primitives in the snapshots
+		void CaptureDebug(bool value)
+		{
+			capture_debug = value;
+		}
+	};
+
+	///A scene hosted by the debugger with its own camera and worker
+	struct SceneView
+	{
+		PhysicsEngine::MyScene* scene;
+		Camera* camera;
+		SceneWorker* worker;
+		//version of the last drawn snapshot
+		PxU32 drawn_version;
+	};
 
 	///simulation objects
+	std::vector<SceneView> views;
+	unsigned int active_view = 0;
+	//show all scenes side by side or the active one only
+	bool tiled_views = true;
+	//the active camera
 	Camera* camera;
-	PhysicsEngine::MyScene* scene;
 	PxReal delta_time = 1.f / 60.f;
 	PxReal gForceStrength = 20;
 	RenderMode render_mode = NORMAL;
-	const int MAX_KEYS = 256;
-	bool key_state[MAX_KEYS];
+	//held keys
+	Input input;
+	//an actor is dragged with the right mouse button
+	bool dragging = false;
+	//change of the force per second while the arrow keys are held
+	const PxReal force_rate = 2.f;
 	bool hud_show = true;
 	HUD hud;
-	std::string myForceString; 
+	//force shown in the HUD and its line on the help screen
+	PxReal hud_force = 0.f;
+	unsigned int hud_force_line = 0;
+	bool show_shot_path = true;
+	//performance overlay
+	PerfOverlay perf;
+	bool perf_show = false;
+	std::chrono::high_resolution_clock::time_point last_frame = std::chrono::high_resolution_clock::now();
+	PxU32 last_heap_allocations = 0;
+	PxU32 last_physx_allocations = 0;
+	//window recording
+	FrameRecorder* recorder = 0;
+	int record_frames = 0;
 
 	//Init the debugger
-	void Init(const char *window_name, int width, int height)
+	void Init(const char *window_name, int width, int height, int num_scenes)
 	{
 		///Init PhysX
 		PhysicsEngine::PxInit();
-		scene = new PhysicsEngine::MyScene();
-		scene->Init();
-	    myForceString = std::to_string(scene->myForce);
+		for (int i = 0; i < num_scenes; i++)
+			AddScene(new PhysicsEngine::MyScene());
+		hud_force = views[active_view].worker->Latest().force;
 		///Init renderer
 		Renderer::BackgroundColor(PxVec3(150.f / 255.f, 150.f / 255.f, 150.f / 255.f));
 		Renderer::SetRenderDetail(40);
 		Renderer::InitWindow(window_name, width, height);
 		Renderer::Init();
 
-		camera = new Camera(PxVec3(0.0f, 110.0f, 15.0f), PxVec3(0.f, -100.0f, 1.f), 30.f);
-
 		//initialise HUD
 		HUDInit();
 
+		//draw at 60 fps, but only when something changes while the scenes are idle
+		Renderer::FrameRate(60.f, 10.f);
+		Renderer::ChangedFunc(ScenesChanged);
+
 		///Assign callbacks
 		//render
 		glutDisplayFunc(RenderScene);
@@ -75,7 +512,10 @@ namespace VisualDebugger
 		//keyboard
 		glutKeyboardFunc(KeyPress);
 		glutSpecialFunc(KeySpecial);
+		glutSpecialUpFunc(KeySpecialRelease);
 		glutKeyboardUpFunc(KeyRelease);
+		//held keys are tracked from press to release, repeats are not needed
+		glutIgnoreKeyRepeat(1);
 
 		//mouse
 		glutMouseFunc(mouseCallback);
@@ -88,6 +528,12 @@ namespace VisualDebugger
 		motionCallback(0, 0);
 	}
 
+	std::string ForceLine(PxReal force)
+	{
+		return "                                                              Force: " + std::to_string(force);
+	}
+
+	//Build the HUD screens once, only the force line changes afterwards
 	void HUDInit()
 	{
 		//initialise HUD
@@ -95,7 +541,7 @@ namespace VisualDebugger
 		hud.AddLine(EMPTY, "");
 		
 		
-		hud.AddLine(HELP, "                                                              " + myForceString);
+		hud_force_line = hud.AddLine(HELP, ForceLine(hud_force));
 
 		//add multiple empty lines
 		for (int i = 0; i < 17; i++)
@@ -110,16 +556,22 @@ namespace VisualDebugger
 		hud.AddLine(HELP, "                                                   UP Arrow       -    Increase Force");
 		hud.AddLine(HELP, "                                                   DOWN Arrow    -    Decrease Force");
 		hud.AddLine(HELP, "                                                   R                  -    Apply Force");
-		for (int i = 0; i < 5; i++)
+		hud.AddLine(HELP, "                                                   Right Mouse  -    Pick and drag");
+		for (int i = 0; i < 4; i++)
 		{
 			hud.AddLine(HELP, "");
 		}
 		hud.AddLine(HELP, "                                                   VIEW CONTROLS");
+		hud.AddLine(HELP, "                                                   F1 - tiled scenes on/off");
+		hud.AddLine(HELP, "                                                   F2 - next scene");
+		hud.AddLine(HELP, "                                                   F3 - shot preview on/off");
 		hud.AddLine(HELP, "                                                   F4 - reset scene");
 		hud.AddLine(HELP, "                                                   F5 - help on/off");
 		hud.AddLine(HELP, "                                                   F6 - shadows on/off");
 		hud.AddLine(HELP, "                                                   F7 - render mode");
 		hud.AddLine(HELP, "                                                   F8 - reset view");
+		hud.AddLine(HELP, "                                                   F11 - recording on/off");
+		hud.AddLine(HELP, "                                                   F12 - performance on/off");
 		hud.AddLine(HELP, "");
 		hud.AddLine(HELP, "                                                   Try to hit the red square!");
 		
@@ -139,6 +591,10 @@ namespace VisualDebugger
 		hud.AddLine(WIN, "                                                                   YOU WIN!");
 		hud.AddLine(WIN, "                                                                F4 - reset scene");
 
+		//add a performance screen, the graphs are drawn by the overlay
+		hud.AddLine(PERF, "   PERFORMANCE");
+		hud.AddLine(PERF, "   F12 - close");
+
 
 
 		//set font size for all screens
@@ -147,39 +603,189 @@ namespace VisualDebugger
 		hud.Color(PxVec3(0.f, 0.f, 0.f));
 	}
 
+	//Add a scene (not initialised yet) to the debugger
+	void AddScene(PhysicsEngine::MyScene* new_scene)
+	{
+		new_scene->Init();
+
+		SceneView view;
+		view.scene = new_scene;
+		view.camera = new Camera(PxVec3(0.0f, 110.0f, 15.0f), PxVec3(0.f, -100.0f, 1.f), 30.f);
+		view.worker = new SceneWorker(new_scene, delta_time);
+		view.drawn_version = 0;
+		views.push_back(view);
+
+		SelectView(active_view);
+	}
+
+	//Make the scene with the given index active (input, HUD and single view)
+	void SelectView(unsigned int index)
+	{
+		unsigned int previous = active_view;
+		active_view = index % views.size();
+		camera = views[active_view].camera;
+
+		//held arrow keys move over to the new scene
+		if ((previous != active_view) && (previous < views.size()))
+		{
+			views[previous].worker->Send(FORCE_RATE, 0.f);
+			views[active_view].worker->Send(FORCE_RATE, HeldForceRate());
+		}
+	}
+
+	//Record the window from the next frame on
+	void Record(const std::string& path, int num_frames)
+	{
+		delete recorder;
+		recorder = new FrameRecorder(path);
+		record_frames = num_frames;
+	}
+
 	//Start the main loop
 	void Start()
 	{
 		glutMainLoop();
 	}
 
-	//Render the scene and perform a single simulation step
-	void RenderScene()
+	//Render a single scene into the current viewport
+	void RenderView(unsigned int index)
 	{
-		//handle pressed keys
-		KeyHold();
+		SceneView& view = views[index];
+		const SceneSnapshot& snapshot = view.worker->Latest();
+		view.drawn_version = snapshot.version;
 
 		//start rendering
-		Renderer::Start(camera->getEye(), camera->getDir());
+		Renderer::Start(view.camera->getEye(), view.camera->getDir());
+
+		//shapes first: their shadow pass borrows the depth buffer, the debug primitives are depth tested against them
+		if ((render_mode == NORMAL) || (render_mode == BOTH))
+		{
+			//one step behind the simulation, the poses of the last two steps are blended at the frame time.
+			//a late step is extrapolated for at most half a step, an idle scene is drawn as it is.
+			PxReal alpha = 1.f;
+			if (!snapshot.idle)
+				alpha = PxClamp((PxReal)((Input::Now() - snapshot.time) / snapshot.time_step), 0.f, 1.5f);
+			Renderer::Render(snapshot.shapes.size() ? &snapshot.shapes.front() : 0, (PxU32)snapshot.shapes.size(),
+				snapshot.cloths.size() ? &snapshot.cloths.front() : 0, (PxU32)snapshot.cloths.size(), alpha);
+		}
 
 		if ((render_mode == DEBUG) || (render_mode == BOTH))
 		{
-			Renderer::Render(scene->Get()->getRenderBuffer());
+			Renderer::Render(snapshot.points.size() ? &snapshot.points.front() : 0, (PxU32)snapshot.points.size(),
+				snapshot.lines.size() ? &snapshot.lines.front() : 0, (PxU32)snapshot.lines.size(),
+				snapshot.triangles.size() ? &snapshot.triangles.front() : 0, (PxU32)snapshot.triangles.size());
 		}
 
-		if ((render_mode == NORMAL) || (render_mode == BOTH))
+		//the latest prediction for the current force
+		if (show_shot_path && snapshot.shot_path.size())
+			Renderer::Render(&snapshot.shot_path.front(), (PxU32)snapshot.shot_path.size(), PxVec3(1.f, 1.f, 0.f), 2.f);
+
+		//per scene timing
+		if (views.size() > 1)
+		{
+			std::ostringstream label;
+			label.precision(2);
+			label << std::fixed << "Scene " << index + 1 << (index == active_view ? " (active)" : "") << "   step " << snapshot.step_time << " ms";
+			Renderer::RenderText(label.str(), PxVec2(0.01f, 0.02f), PxVec3(0.f, 0.f, 0.f), 0.03f);
+		}
+	}
+
+	//Get the part of the window that shows a scene (in pixels, origin at the bottom left), returns false if it is not shown
+	bool ViewRect(unsigned int index, int& x, int& y, int& width, int& height)
+	{
+		int window_width = Renderer::WindowWidth();
+		int window_height = Renderer::WindowHeight();
+
+		if (tiled_views && (views.size() > 1))
 		{
-			std::vector<PxActor*> actors = scene->GetAllActors();
-			if (actors.size())
-				Renderer::Render(&actors[0], (PxU32)actors.size());
+			//a grid of viewports, first scene in the top left corner
+			int columns = (int)std::ceil(std::sqrt((float)views.size()));
+			int rows = ((int)views.size() + columns - 1) / columns;
+			width = window_width / columns;
+			height = window_height / rows;
+			x = (index % columns)*width;
+			y = window_height - (index / columns + 1)*height;
+			return true;
 		}
 
+		x = y = 0;
+		width = window_width;
+		height = window_height;
+		return index == active_view;
+	}
+
+	//Is there a newer snapshot of a scene on screen than the one drawn
+	bool ScenesChanged()
+	{
+		for (unsigned int i = 0; i < views.size(); i++)
+		{
+			int x, y, width, height;
+			if (ViewRect(i, x, y, width, height) && (views[i].worker->Latest().version != views[i].drawn_version))
+				return true;
+			//keep drawing until every command has reached its scene
+			if (views[i].worker->Flush())
+				return true;
+		}
+		return false;
+	}
+
+	//Render the latest snapshot of all scenes
+	void RenderScene()
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		Clock::time_point frame_start = Clock::now();
+		std::chrono::duration<PxReal, std::milli> frame_time = frame_start - last_frame;
+		last_frame = frame_start;
+		Renderer::DrawCalls(0);
+
+		//allocations since the previous frame started
+		PxU32 heap_allocations = HeapAllocations();
+		PxU32 physx_allocations = PhysicsEngine::Allocations();
+		PxU32 frame_heap_allocations = heap_allocations - last_heap_allocations;
+		PxU32 frame_physx_allocations = physx_allocations - last_physx_allocations;
+		last_heap_allocations = heap_allocations;
+		last_physx_allocations = physx_allocations;
+
+		//debug primitives are copied only while they are drawn
+		for (unsigned int i = 0; i < views.size(); i++)
+		{
+			views[i].worker->CaptureDebug(render_mode != NORMAL);
+			//commands that waited for a full queue
+			views[i].worker->Flush();
+			StepSample sample;
+			while (views[i].worker->PopStep(sample))
+			{
+				if (i == active_view)
+					perf.AddStep(sample);
+			}
+		}
+
+		//handle pressed keys
+		KeyHold();
+
+		int window_width = Renderer::WindowWidth();
+		int window_height = Renderer::WindowHeight();
+
+		for (unsigned int i = 0; i < views.size(); i++)
+		{
+			int x, y, width, height;
+			if (ViewRect(i, x, y, width, height))
+			{
+				Renderer::Viewport(x, y, width, height);
+				RenderView(i);
+			}
+		}
+
+		//the HUD covers the whole window
+		Renderer::Viewport(0, 0, window_width, window_height);
+		Clock::time_point hud_start = Clock::now();
+		const SceneSnapshot& active = views[active_view].worker->Latest();
 
 
 		//adjust the HUD state
 		if (hud_show)
 		{
-			if (scene->Pause())
+			if (active.paused)
 				hud.ActiveScreen(PAUSE);
 			else
 				hud.ActiveScreen(HELP);
@@ -188,23 +794,50 @@ namespace VisualDebugger
 			hud.ActiveScreen(EMPTY);
 	    
 
-		 if (scene->hasWon)
+		 if (active.won)
 		{
 			hud.ActiveScreen(WIN);
 			
 		}
+
+		if (perf_show)
+			hud.ActiveScreen(PERF);
+		//the help screen is laid out again only when the force changes
+		if (active.force != hud_force)
+		{
+			hud_force = active.force;
+			hud.SetLine(HELP, hud_force_line, ForceLine(hud_force));
+		}
+
 		//render HUD
 		hud.Render();
-		hud.Clear(); 
-		HUDInit();
-		myForceString = "Force: " + std::to_string(scene->myForce); 
+		if (perf_show)
+			perf.Render();
+		Renderer::FlushText();
+
+		Clock::time_point hud_end = Clock::now();
+		std::chrono::duration<PxReal, std::milli> render_time = hud_start - frame_start;
+		std::chrono::duration<PxReal, std::milli> hud_time = hud_end - hud_start;
+		perf.AddFrame(frame_time.count(), render_time.count(), hud_time.count(),
+			Renderer::DrawCalls(), frame_heap_allocations, frame_physx_allocations);
 
 
+		//read the frame back before the buffers are swapped
+		if (recorder)
+		{
+			recorder->Capture(0, 0, window_width, window_height);
+			if (record_frames && (recorder->Frames() >= (PxU32)record_frames))
+				exit(0);
+		}
+
 		//finish rendering
 		Renderer::Finish();
 
-		//perform a single simulation step
-		scene->Update(delta_time);
+		//throttle while nothing moves and nobody interacts
+		bool idle = !input.Count() && !dragging && !recorder && !perf_show;
+		for (unsigned int i = 0; idle && (i < views.size()); i++)
+			idle = views[i].worker->Latest().idle;
+		Renderer::Idle(idle);
 	}
 
 	//user defined keyboard handlers
@@ -215,7 +848,7 @@ namespace VisualDebugger
 			//implement your own
 		case 'R':
 			//add force when 'R' is pressed 
-			scene->push();
+			views[active_view].worker->Send(PUSH);
 			break;
 		default:
 			break;
@@ -262,21 +895,44 @@ namespace VisualDebugger
 		}
 	}
 
+	//force change per second for the held arrow keys
+	PxReal HeldForceRate()
+	{
+		PxReal rate = 0.f;
+		if (input.IsHeld(Input::SPECIAL_KEY + GLUT_KEY_UP))
+			rate += force_rate;
+		if (input.IsHeld(Input::SPECIAL_KEY + GLUT_KEY_DOWN))
+			rate -= force_rate;
+		return rate;
+	}
+
 	///handle special keys
 	void KeySpecial(int key, int x, int y)
 	{
+		Renderer::Redraw();
+
+		//do it only once
+		if (!input.Press(Input::SPECIAL_KEY + key, Input::Now()))
+			return;
+
 		//simulation control
 		switch (key)
 		{
+			//scene control
+		case GLUT_KEY_F1:
+			//all scenes side by side or the active one only
+			tiled_views = !tiled_views;
+			break;
+		case GLUT_KEY_F2:
+			//switch to the next scene
+			SelectView(active_view + 1);
+			break;
 			
-			//Add force
+			//Add or subtract force while held
 		case GLUT_KEY_UP:
-			scene->myForce += 0.1f; 
-			break;
-			//Subtract force
 		case GLUT_KEY_DOWN:
-			scene->myForce -= 0.1f; 
-			break; 
+			views[active_view].worker->Send(FORCE_RATE, HeldForceRate());
+			break;
 
 			//display control
 		case GLUT_KEY_F5:
@@ -295,39 +951,64 @@ namespace VisualDebugger
 			//reset camera view
 			camera->Reset();
 			break;
+		case GLUT_KEY_F3:
+			//shot preview on/off
+			show_shot_path = !show_shot_path;
+			break;
+		case GLUT_KEY_F11:
+			//recording on/off
+			if (recorder)
+			{
+				delete recorder;
+				recorder = 0;
+			}
+			else
+				Record("capture");
+			break;
+		case GLUT_KEY_F12:
+			//performance overlay on/off
+			perf_show = !perf_show;
+			break;
 
 			//simulation control
 		case GLUT_KEY_F9:
 			//select next actor
-			scene->SelectNextActor();
+			views[active_view].worker->Send(SELECT_NEXT_ACTOR);
 			break;
 		case GLUT_KEY_F10:
 			//toggle scene pause
-			scene->Pause(!scene->Pause());
+			views[active_view].worker->Send(PAUSE_TOGGLE);
 			break;
 		case GLUT_KEY_F4:
 			//resect scene
-			scene->myForce = 0; 
-			scene->hasWon = false;
-			scene->swichBoxPosition();
-			scene->Reset();
-			
-			
+			views[active_view].worker->Send(RESET);
 			break;
 		default:
 			break;
 		}
 	}
 
+	///handle special key release
+	void KeySpecialRelease(int key, int x, int y)
+	{
+		Renderer::Redraw();
+
+		if (!input.Release(Input::SPECIAL_KEY + key))
+			return;
+
+		if ((key == GLUT_KEY_UP) || (key == GLUT_KEY_DOWN))
+			views[active_view].worker->Send(FORCE_RATE, HeldForceRate());
+	}
+
 	//handle single key presses
 	void KeyPress(unsigned char key, int x, int y)
 	{
+		Renderer::Redraw();
+
 		//do it only once
-		if (key_state[key] == true)
+		if (!input.Press(key, Input::Now()))
 			return;
 
-		key_state[key] = true;
-
 		//exit
 		if (key == 27)
 			exit(0);
@@ -338,19 +1019,23 @@ namespace VisualDebugger
 	//handle key release
 	void KeyRelease(unsigned char key, int x, int y)
 	{
-		key_state[key] = false;
+		Renderer::Redraw();
+
+		input.Release(key);
+
 		UserKeyRelease(key);
 	}
 
-	//handle holded keys
+	//handle holded keys, only the keys that are actually held are visited
 	void KeyHold()
 	{
-		for (int i = 0; i < MAX_KEYS; i++)
+		for (unsigned int i = 0; i < input.Count(); i++)
 		{
-			if (key_state[i]) // if key down
+			int key = input.Held(i).key;
+			if (key < Input::SPECIAL_KEY)
 			{
-				CameraInput(i);
-				UserKeyHold(i);
+				CameraInput(key);
+				UserKeyHold(key);
 			}
 		}
 	}
@@ -359,12 +1044,47 @@ namespace VisualDebugger
 	int mMouseX = 0;
 	int mMouseY = 0;
 
+	//Ray from the active camera through the cursor (GLUT window coordinates).
+	//With select_view the scene under the cursor becomes active first.
+	void CursorRay(int cursor_x, int cursor_y, bool select_view, PxVec3& origin, PxVec3& direction)
+	{
+		int x, y, width, height;
+		int window_y = Renderer::WindowHeight() - cursor_y;
+
+		if (select_view)
+		{
+			for (unsigned int i = 0; i < views.size(); i++)
+			{
+				if (ViewRect(i, x, y, width, height) && (cursor_x >= x) && (cursor_x < x + width) && (window_y >= y) && (window_y < y + height))
+				{
+					SelectView(i);
+					break;
+				}
+			}
+		}
+
+		ViewRect(active_view, x, y, width, height);
+		PxReal view_x = 2.f*(cursor_x - x)/PxMax(width, 1) - 1.f;
+		PxReal view_y = 2.f*(window_y - y)/PxMax(height, 1) - 1.f;
+		origin = camera->getEye();
+		direction = camera->getRay(view_x, view_y, Renderer::FieldOfView(), (PxReal)width/PxMax(height, 1));
+	}
+
 	void motionCallback(int x, int y)
 	{
+		Renderer::Redraw();
+
 		int dx = mMouseX - x;
 		int dy = mMouseY - y;
 
-		camera->Motion(dx, dy, delta_time);
+		if (dragging)
+		{
+			PxVec3 origin, direction;
+			CursorRay(x, y, false, origin, direction);
+			views[active_view].worker->Send(DRAG, origin, direction);
+		}
+		else
+			camera->Motion(dx, dy, delta_time);
 
 		mMouseX = x;
 		mMouseY = y;
@@ -372,8 +1092,27 @@ namespace VisualDebugger
 
 	void mouseCallback(int button, int state, int x, int y)
 	{
+		Renderer::Redraw();
+
 		mMouseX = x;
 		mMouseY = y;
+
+		//pick the actor under the cursor and drag it while the button is held
+		if (button == GLUT_RIGHT_BUTTON)
+		{
+			if (state == GLUT_DOWN)
+			{
+				PxVec3 origin, direction;
+				CursorRay(x, y, true, origin, direction);
+				views[active_view].worker->Send(PICK, origin, direction);
+				dragging = true;
+			}
+			else if (dragging)
+			{
+				views[active_view].worker->Send(END_DRAG);
+				dragging = false;
+			}
+		}
 	}
 
 	void ToggleRenderMode()
@@ -389,8 +1128,17 @@ namespace VisualDebugger
 	///exit callback
 	void exitCallback(void)
 	{
-		delete camera;
-		delete scene;
+		for (unsigned int i = 0; i < views.size(); i++)
+		{
+			delete views[i].worker;
+			delete views[i].camera;
+			delete views[i].scene;
+		}
+		views.clear();
+		//write the remaining frames
+		delete recorder;
+		recorder = 0;
+		Renderer::Release();
 		PhysicsEngine::PxRelease();
 	}
 }
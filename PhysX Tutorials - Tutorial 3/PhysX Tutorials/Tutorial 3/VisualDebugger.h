@@ -1,13 +1,21 @@
 #pragma once
 
 #include "MyPhysicsEngine.h"
+#include "ShotPreview.h"
 
 namespace VisualDebugger
 {
 	using namespace physx;
 
-	///Init visualisation
-	void Init(const char *window_name, int width=512, int height=512);
+	///Init visualisation with one or more scenes (shown side by side)
+	void Init(const char *window_name, int width=512, int height=512, int num_scenes=1);
+
+	///Add another scene, e.g. with different physics settings, before calling Start
+	void AddScene(PhysicsEngine::MyScene* scene);
+
+	///Record the window to a numbered PPM sequence (path_00000.ppm, ...) from the first frame,
+	///exit after num_frames frames if it is not 0. Call after Init.
+	void Record(const std::string& path, int num_frames=0);
 
 	///Start visualisation
 	void Start();